@@ -0,0 +1,78 @@
+/**
+ * MMD kernels (cco_mmd library)
+ *
+ * One compiled copy of the MMD evaluation and weight loading shared by the planner, the
+ * A* search and the MMD map. MMDKernel is specialized at compile time on the number of
+ * samples and the kernel, so every evaluation runs on fixed-size Eigen types that live on
+ * the stack and get unrolled / vectorized by the compiler.
+ *
+ * Instantiations compiled into the library: the 5 transformed features of the 100x5 weight
+ * files, for the polynomial and the RBF kernel. The batch evaluation of the optimizer goes
+ * through a caller owned MMDBatchScratch and does not allocate once it has grown.
+ **/
+#pragma once
+
+#include <Eigen/Dense>
+#include <string>
+
+namespace MMDFunctions
+{
+    enum KernelType
+    {
+        POLYNOMIAL_KERNEL, // (1 + xy)^2
+        RBF_KERNEL,        // exp(-(x - y)^2 / (2 sigma^2))
+        RFF_KERNEL         // RBF approximated with random Fourier features, see MMD_rff.h
+    };
+
+    const float RBF_BANDWIDTH = 0.1;
+
+    const int NUM_DISTRIBUTION_SAMPLES = 100; // samples of a distance distribution
+    const int NUM_TRANSFORMED_FEATURES = 5;   // columns of weight.csv / weight2.csv / weight_rbf.csv
+
+    typedef Eigen::Matrix<float, 1, NUM_DISTRIBUTION_SAMPLES> DistanceDistribution;
+    typedef Eigen::Matrix<float, NUM_DISTRIBUTION_SAMPLES, NUM_TRANSFORMED_FEATURES> WeightMatrix;
+
+    /** MMD of NumSamples values against the ideal (all zero) distribution **/
+    template <int NumSamples, KernelType Kernel>
+    struct MMDKernel
+    {
+        typedef Eigen::Matrix<float, 1, NumSamples> Samples;
+
+        static float evaluate(const Samples &samples);
+    };
+
+    /** MMD of the transformed features (distribution * weights), the distribution must hold 100 samples **/
+    float transformed_MMD(const Eigen::Ref<const Eigen::RowVectorXf> &distribution, const WeightMatrix &weights, KernelType kernel = POLYNOMIAL_KERNEL);
+
+    /** same as above for every row of distributions, written to mmd_values(row) **/
+    void transformed_MMD_batch(const Eigen::Ref<const Eigen::MatrixXf> &distributions, const WeightMatrix &weights, Eigen::VectorXf &mmd_values, KernelType kernel = POLYNOMIAL_KERNEL);
+
+    /** buffers of transformed_MMD_batch, only grown (never shrunk) so that a reused scratch does not allocate **/
+    struct MMDBatchScratch
+    {
+        Eigen::Matrix<float, Eigen::Dynamic, NUM_TRANSFORMED_FEATURES> features; // distributions * weights
+        Eigen::VectorXf values;                                                  // the first rows hold the MMDs of the last batch
+    };
+
+    /** same as above through scratch, the MMD of row r goes to scratch.values(r); returns their sum **/
+    double transformed_MMD_batch(const Eigen::Ref<const Eigen::MatrixXf> &distributions, const WeightMatrix &weights, MMDBatchScratch &scratch, KernelType kernel = POLYNOMIAL_KERNEL);
+
+    /** RBF MMD of num_samples raw values, SIMD Gram sums with a polynomial exp (see src/MMD_rbf.cpp for the accuracy) **/
+    float rbf_MMD(const float *samples, int num_samples, float bandwidth = RBF_BANDWIDTH);
+
+    /** instruction set picked at runtime for rbf_MMD: "avx512", "avx2" or "scalar" **/
+    const char *rbf_simd_level();
+
+    /** degree 6 polynomial fit of the MMD against the EDT distance, no sampling **/
+    float interpolated_MMD(float dist);
+
+    /**
+     * Copy the weights of path_to_weights (binary or CSV) into weights through the shared WeightStore,
+     * the file is only read the first time a path is requested in the process
+     * Returns false (and leaves weights untouched) if the file cannot be read or its shape does not match
+     **/
+    bool load_weights(const std::string &path_to_weights, Eigen::Ref<Eigen::MatrixXf> weights);
+
+    extern template struct MMDKernel<NUM_TRANSFORMED_FEATURES, POLYNOMIAL_KERNEL>;
+    extern template struct MMDKernel<NUM_TRANSFORMED_FEATURES, RBF_KERNEL>;
+}
@@ -0,0 +1,148 @@
+/**
+ * Distance to MMD lookup table
+ *
+ * With a fixed noise model the MMD cost of a waypoint only depends on its EDT distance.
+ * The table samples the MMD estimator on a uniform grid over [min_distance, max_distance]
+ * once, and serves the cost with linear or cubic (Catmull-Rom) interpolation afterwards.
+ * While building, the interpolant is compared against the estimator at three points inside
+ * every cell and the worst absolute difference is kept in max_error. That only measures the
+ * interpolation: when the estimator averages several noise draws, an optional reference
+ * estimator (independent draws, as the sampled cost sees them) gives sampled_error, the mean
+ * |lookup - reference| relative to the mean reference at the same points.
+ **/
+#pragma once
+
+#include <Eigen/Dense>
+#include <functional>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+namespace MMDFunctions
+{
+    class MMD_lookup_table
+    {
+    public:
+        enum Interpolation
+        {
+            LINEAR,
+            CUBIC
+        };
+
+        // evaluates the MMD at every distance in one (batched) call
+        typedef std::function<void(const Eigen::VectorXf &distances, Eigen::VectorXf &mmd_values)> BatchEstimator;
+
+        float min_distance = 0.0;
+        float max_distance = 2.0;
+        float step = 0.01;
+        Interpolation interpolation = CUBIC;
+        std::vector<float> table;
+        float max_error = 0;     // worst case |lookup - estimator| found while building
+        float sampled_error = 0; // mean |lookup - reference| / mean reference, 0 without a reference
+
+        void build(const BatchEstimator &estimator, float min_distance_ = 0.0, float max_distance_ = 2.0, int num_entries = 201, Interpolation interpolation_ = CUBIC,
+                   const BatchEstimator &reference = BatchEstimator());
+        float lookup(float distance) const;
+        bool is_built() const { return !table.empty(); }
+
+    private:
+        float entry(int index) const;
+    };
+}
+
+inline void MMDFunctions::MMD_lookup_table::build(const BatchEstimator &estimator, float min_distance_, float max_distance_, int num_entries, Interpolation interpolation_,
+                                                  const BatchEstimator &reference)
+{
+    min_distance = min_distance_;
+    max_distance = max_distance_;
+    interpolation = interpolation_;
+    step = (max_distance - min_distance) / float(num_entries - 1);
+
+    Eigen::VectorXf distances = Eigen::VectorXf::LinSpaced(num_entries, min_distance, max_distance);
+    Eigen::VectorXf values;
+
+    estimator(distances, values);
+
+    table.assign(values.data(), values.data() + values.size());
+
+    // validate the interpolant at the quarter points of every cell
+    int probes_per_cell = 3;
+    Eigen::VectorXf probe_distances((num_entries - 1) * probes_per_cell);
+
+    for (int k = 0; k < num_entries - 1; k++)
+    {
+        for (int j = 0; j < probes_per_cell; j++)
+        {
+            probe_distances(k * probes_per_cell + j) = min_distance + (float(k) + float(j + 1) / float(probes_per_cell + 1)) * step;
+        }
+    }
+
+    Eigen::VectorXf expected;
+    estimator(probe_distances, expected);
+
+    max_error = 0;
+
+    for (int i = 0; i < probe_distances.size(); i++)
+    {
+        max_error = std::max(max_error, std::abs(lookup(probe_distances(i)) - expected(i)));
+    }
+
+    sampled_error = 0;
+
+    if (reference)
+    {
+        Eigen::VectorXf sampled;
+        reference(probe_distances, sampled);
+
+        double sum_error = 0, sum_reference = 0;
+
+        for (int i = 0; i < probe_distances.size(); i++)
+        {
+            sum_error += std::abs(lookup(probe_distances(i)) - sampled(i));
+            sum_reference += std::abs(sampled(i));
+        }
+
+        sampled_error = sum_reference > 0 ? float(sum_error / sum_reference) : 0.0f;
+    }
+
+    std::cout << "MMD lookup table built with " << num_entries << " entries over [" << min_distance << ", " << max_distance << "], worst case error " << max_error;
+
+    if (reference)
+        std::cout << ", relative error against independent draws " << sampled_error;
+
+    std::cout << std::endl;
+}
+
+inline float MMDFunctions::MMD_lookup_table::entry(int index) const
+{
+    int last = int(table.size()) - 1;
+
+    // ghost entries past the ends are extrapolated linearly so the end cells keep their slope
+    if (index < 0)
+        return 2.0f * table[0] - table[1];
+    if (index > last)
+        return 2.0f * table[last] - table[last - 1];
+
+    return table[index];
+}
+
+inline float MMDFunctions::MMD_lookup_table::lookup(float distance) const
+{
+    float position = (std::min(std::max(distance, min_distance), max_distance) - min_distance) / step;
+
+    int index = std::min(int(position), int(table.size()) - 2);
+    float t = position - float(index);
+
+    if (interpolation == LINEAR)
+    {
+        return entry(index) + t * (entry(index + 1) - entry(index));
+    }
+
+    // Catmull-Rom through the four neighbouring entries
+    float p0 = entry(index - 1);
+    float p1 = entry(index);
+    float p2 = entry(index + 1);
+    float p3 = entry(index + 2);
+
+    return p1 + 0.5f * t * (p2 - p0 + t * (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3 + t * (3.0f * (p1 - p2) + p3 - p0)));
+}
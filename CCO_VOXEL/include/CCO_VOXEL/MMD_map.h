@@ -1,4 +1,9 @@
 #include <dynamicEDT3D/dynamicEDTOctomap.h>
+#include "MMD_moments.h"
+#include "MMD_kernels.h"
+#include "MMD_lookup_table.h"
+#include "qmc_noise.h"
+#include "map_snapshot.h"
 
 namespace MMD_Map
 {
@@ -13,7 +18,7 @@ namespace MMD_Map
         octomap::point3d start, end;
         double octree_resolution = 0.2;
         double resolution_factor = 1 / octree_resolution;
-        octomap::OcTree *octree_for_mmd;
+        const octomap::OcTree *octree_for_mmd;
         octomap::point3d mmd_map_start, mmd_map_end;
 
         int key_x, key_y, key_z;
@@ -57,10 +62,16 @@ namespace MMD_Map
         std::map<MMD_Map_key, MMD_Cost> MMD_data;
         std::map<Occupancy_Map_key, bool> Occupancy_data;
 
+        bool use_mmd_lut = true;                  // tabulate the MMD over the leaf distances instead of evaluating every leaf
+        MMDFunctions::MMD_lookup_table mmd_table; // rebuilt with the noise distribution of every update
+        uint32_t update_count = 0;                // epoch of the noise stream
+        RandomStreams::NoiseSampling noise_sampling = RandomStreams::PSEUDO_RANDOM;
+
         // void update_mmd_map();
 
-        void update_MMD_Map(DynamicEDTOctomap *ptr, visualization_msgs::MarkerArray mdd_marker, ros::Publisher MMD_map_pub);
-        double compute_MMD_linear_transforms(Eigen::MatrixXf actual_distribution);
+        void update_MMD_Map(const Map3D::MapSnapshot &map, visualization_msgs::MarkerArray mdd_marker, ros::Publisher MMD_map_pub);
+        double compute_MMD_linear_transforms(const Eigen::MatrixXf &actual_distribution);
+        void compute_MMD_linear_transforms_batch(const Eigen::MatrixXf &distributions, Eigen::VectorXf &mmd_values);
         void assign_weights_for_MMD();
         void convert_point_to_key(octomap::point3d inpt, int &key_x, int &key_y, int &key_z);
         std::tuple<int, int, int> convert_point_to_key_external(octomap::point3d inPt);
@@ -246,103 +257,19 @@ std::tuple<int, int, int> MMD_Map::MMD_Map_Functions::convert_point_to_key_exter
 void MMD_Map::MMD_Map_Functions::assign_weights_for_MMD()
 {
 
-    int rows = 100;
-    int cols = 5;
-    std::string file = "../src/CCO_VOXEL/include/CCO_VOXEL/weight.csv";
-    std::ifstream in(file);
-
-    std::string line;
-
-    int row = 0;
-    int col = 0;
-
-    Eigen::MatrixXf res = Eigen::MatrixXf(rows, cols);
-
-    if (in.is_open())
-    {
-
-        while (std::getline(in, line))
-        {
-
-            char *ptr = (char *)line.c_str();
-            int len = line.length();
-
-            col = 0;
-
-            char *start = ptr;
-            for (int i = 0; i < len; i++)
-            {
-
-                if (ptr[i] == ',')
-                {
-                    res(row, col++) = atof(start);
-                    start = ptr + i + 1;
-                }
-            }
-            res(row, col) = atof(start);
-
-            row++;
-        }
-
-        in.close();
-    }
-
-    Weights = res;
-
-    std::cout << Weights.rows() << " " << Weights.cols() << std::endl;
+    MMDFunctions::load_weights("../src/CCO_VOXEL/include/CCO_VOXEL/weight.csv", Weights);
 }
 
-double MMD_Map::MMD_Map_Functions::compute_MMD_linear_transforms(Eigen::MatrixXf actual_distribution)
+double MMD_Map::MMD_Map_Functions::compute_MMD_linear_transforms(const Eigen::MatrixXf &actual_distribution)
 {
 
-    Eigen::MatrixXf transformed_features(1, 5);
-
-    transformed_features = actual_distribution * Weights;
-
-    // std::cout << transformed_features << std::endl;
-
-    int num_samples_of_distance_distribution = transformed_features.cols();
-    Eigen::MatrixXf squared_dist(1, num_samples_of_distance_distribution);
-    Eigen::MatrixXf temp(1, num_samples_of_distance_distribution);
-    Eigen::MatrixXf alpha_weights(1, num_samples_of_distance_distribution);
-
-    alpha_weights.setOnes();
-
-    // temp = actual_distribution.array();
-
-    squared_dist = (transformed_features.array()).square();
-
-    Eigen::MatrixXf kernel_matrix1(num_samples_of_distance_distribution, num_samples_of_distance_distribution);
-    Eigen::MatrixXf temp_kernel_matrix1(num_samples_of_distance_distribution, num_samples_of_distance_distribution);
-    Eigen::MatrixXf temp_kernel_matrix2(num_samples_of_distance_distribution, num_samples_of_distance_distribution);
-
-    Eigen::MatrixXf One_matrix(num_samples_of_distance_distribution, num_samples_of_distance_distribution);
-    One_matrix.setOnes();
-
-    // std::cout << " Entered the main funciton /////////////" << std::endl;
-    temp_kernel_matrix1 = transformed_features.transpose() * transformed_features;
-
-    temp_kernel_matrix2 = squared_dist.transpose() * squared_dist;
-
-    kernel_matrix1 = One_matrix + 2 * temp_kernel_matrix1 + temp_kernel_matrix2;
-
-    Eigen::Matrix<float, 1, 1> res;
-    Eigen::Matrix<float, 1, 1> res1;
-    Eigen::Matrix<float, 1, 1> res2;
-    Eigen::Matrix<float, 1, 1> res3;
-
-    float temp_value = 0;
-
-    double res_val;
-    res1 = alpha_weights * kernel_matrix1 * (alpha_weights.transpose());
-
-    res2(0, 0) = num_samples_of_distance_distribution;
-    res3(0, 0) = num_samples_of_distance_distribution;
+    return double(MMDFunctions::transformed_MMD(actual_distribution, Weights));
+}
 
-    res(0, 0) = res1(0, 0) - 2 * res2(0, 0) + res3(0, 0);
-    res_val = double(res(0, 0));
+void MMD_Map::MMD_Map_Functions::compute_MMD_linear_transforms_batch(const Eigen::MatrixXf &distributions, Eigen::VectorXf &mmd_values)
+{
 
-    return res_val;
+    MMDFunctions::polynomial_MMD_batch(distributions, Weights, mmd_values);
 }
 
 float MMD_Map::MMD_Map_Functions::get_MMD_cost_per_point(octomap::point3d Query_Point)
@@ -373,7 +300,7 @@ float MMD_Map::MMD_Map_Functions::get_MMD_cost_per_point(octomap::point3d Query_
     return MMD_value;
 }
 
-void MMD_Map::MMD_Map_Functions::update_MMD_Map(DynamicEDTOctomap *ptr, visualization_msgs::MarkerArray mdd_marker, ros::Publisher MMD_map_pub)
+void MMD_Map::MMD_Map_Functions::update_MMD_Map(const Map3D::MapSnapshot &map, visualization_msgs::MarkerArray mdd_marker, ros::Publisher MMD_map_pub)
 {
 
     unsigned char maxDepth = 16;
@@ -381,26 +308,23 @@ void MMD_Map::MMD_Map_Functions::update_MMD_Map(DynamicEDTOctomap *ptr, visualiz
     int count = 0;
     octomap::OcTreeKey key_from_octomap;
     int num_samples_of_distance_distribution = 100;
-    std::random_device rd{};
-    std::mt19937 gen{rd()};
 
-    std::normal_distribution<> noise{0, 2};
+    Eigen::MatrixXf noise(1, num_samples_of_distance_distribution);
     Eigen::MatrixXf noise_distribution(1, num_samples_of_distance_distribution);
     Eigen::MatrixXf radius(1, num_samples_of_distance_distribution);
     // radius.setOnes();
     radius = Eigen::MatrixXf::Constant(1, num_samples_of_distance_distribution, 0.75);
-    Eigen::MatrixXf actual_distance(1, num_samples_of_distance_distribution);
-    Eigen::MatrixXf actual_distribution(1, num_samples_of_distance_distribution);
-    Eigen::MatrixXf zero_matrix(1, num_samples_of_distance_distribution);
-    zero_matrix.setZero();
     assign_weights_for_MMD();
     int mmd_num_counter = 0;
 
-    for (int i = 0; i < num_samples_of_distance_distribution; i++)
-    {
+    RandomStreams::fill_noise(noise_sampling, RandomStreams::Stream(RandomStreams::MAP_NOISE, update_count++), noise.data(), num_samples_of_distance_distribution, 0.0, 2.0);
 
-        noise_distribution(0, i) = radius(0, i) - float(noise(gen));
-    }
+    noise_distribution = radius - noise;
+
+    std::vector<octomap::point3d> leaf_points;
+    std::vector<MMD_Map_key> leaf_keys;
+    std::vector<float> leaf_distances;
+    std::vector<int> near_obstacle; // leaves whose MMD has to be evaluated
 
     for (octomap::OcTree::leaf_bbx_iterator it = octree_for_mmd->begin_leafs_bbx(mmd_map_start, mmd_map_end, maxDepth), bbx_end = octree_for_mmd->end_leafs_bbx(); it != bbx_end; std::advance(it, 3))
     {
@@ -434,6 +358,62 @@ void MMD_Map::MMD_Map_Functions::update_MMD_Map(DynamicEDTOctomap *ptr, visualiz
             break;
         }
 
+        float dist = map.distance(pt);
+
+        double threshold_val = 0.75 - (dist - 2);
+
+        if (threshold_val > 0)
+        {
+            near_obstacle.push_back(leaf_points.size());
+        }
+
+        leaf_points.push_back(pt);
+        leaf_keys.push_back(Key_data);
+        leaf_distances.push_back(dist);
+    }
+
+    Eigen::VectorXf mmd_values(near_obstacle.size());
+
+    if (use_mmd_lut)
+    {
+        // leaves are only evaluated below 0.75 + 2 m, tabulate that range once for this noise distribution
+        mmd_table.build([&](const Eigen::VectorXf &distances, Eigen::VectorXf &table_values)
+                        {
+                            Eigen::MatrixXf table_distributions = (noise_distribution.replicate(distances.size(), 1).colwise() - distances).cwiseMax(0.0f);
+                            compute_MMD_linear_transforms_batch(table_distributions, table_values);
+                        },
+                        0.0, 2.75, 276);
+
+        for (int r = 0; r < near_obstacle.size(); r++)
+        {
+            mmd_values(r) = mmd_table.lookup(leaf_distances.at(near_obstacle.at(r)));
+        }
+    }
+    else
+    {
+        // MMD of every leaf close to an obstacle in one batched evaluation
+        Eigen::MatrixXf distributions(near_obstacle.size(), num_samples_of_distance_distribution);
+
+        for (int r = 0; r < near_obstacle.size(); r++)
+        {
+            distributions.row(r) = (noise_distribution.array() - leaf_distances.at(near_obstacle.at(r))).max(0.0f);
+        }
+
+        compute_MMD_linear_transforms_batch(distributions, mmd_values); // compute_MMD_linear_transforms(actual_distribution ); //get_EDT_cost(actual_distribution );  //compute_EDT_interpolation(dist ); //get_EDT_cost(dist ); *
+    }
+    mmd_num_counter = near_obstacle.size();
+
+    std::vector<float> leaf_MMD(leaf_points.size(), 0);
+
+    for (int r = 0; r < near_obstacle.size(); r++)
+    {
+        leaf_MMD.at(near_obstacle.at(r)) = mmd_values(r);
+    }
+
+    for (int l = 0; l < leaf_points.size(); l++)
+    {
+        octomap::point3d pt = leaf_points.at(l);
+
         visualization_msgs::Marker marker;
         marker.header.frame_id = "map";
         marker.header.stamp = ros::Time::now();
@@ -462,45 +442,15 @@ void MMD_Map::MMD_Map_Functions::update_MMD_Map(DynamicEDTOctomap *ptr, visualiz
         marker.scale.z = 0.30;
 
         // set the color of the cell based on the distance from the obstacle
-        float dist = ptr->getDistance(pt);
-        float MMD_val = 0;
-
-        double threshold_val = 0.75 - (dist - 2);
-
-        if (threshold_val > 0)
-        {
-            actual_distance = Eigen::MatrixXf::Constant(1, num_samples_of_distance_distribution, dist);
-            actual_distribution = zero_matrix.cwiseMax(noise_distribution - actual_distance);
-
-            MMD_val = compute_MMD_linear_transforms(actual_distribution); // compute_MMD_linear_transforms(actual_distribution ); //get_EDT_cost(actual_distribution );  //compute_EDT_interpolation(dist ); //get_EDT_cost(dist ); *
-
-            mmd_num_counter++;
-            // std::cout <<  mmd_num_counter << std::endl;
-        }
-
-        if (threshold_val <= 0)
-        {
-
-            MMD_val = 0;
-        }
-
-        unsigned short int a;
-
-        // std::cout << MMD_val <<  " MMD_val " << std::endl;
+        float dist = leaf_distances.at(l);
+        float MMD_val = leaf_MMD.at(l);
 
         MMD_Cost MMDc;
 
         MMDc.MMD_cost_per_point = MMD_val;
         MMDc.mean_obstacle_distance = dist;
 
-        MMD_data[Key_data] = MMDc;
-
-        // std::cout << MMD_data[Key_data].MMD_cost_per_point <<  " " << MMD_val << std::endl;
-
-        // std::cout << Key_data.xkey << " " << Key_data.ykey << "  " << Key_data.zkey << std::endl;
-
-        // std::cout << key_from_octomap[0] << "  "  <<  key_from_octomap[1] << " "<<  key_from_octomap[2] <<  std::endl;
-        // std::cout << "--------------" << std::endl;
+        MMD_data[leaf_keys.at(l)] = MMDc;
 
         marker.color.r = std::sqrt(std::sqrt(MMD_val / 10000.0));
         marker.color.g = (1 - MMD_val / 10000.0) * (1 - MMD_val / 10000.0);
@@ -512,46 +462,6 @@ void MMD_Map::MMD_Map_Functions::update_MMD_Map(DynamicEDTOctomap *ptr, visualiz
     }
 
     MMD_map_pub.publish(mdd_marker);
-    // delta_Vector.x() = gradient_stepx;
-    // delta_Vector.y() = gradient_stepy;
-    // delta_Vector.z() = gradient_stepz;
-    // delta = convertToOctomapPt(delta_Vector);
-    // Eigen::Vector3d gradient_Vector_per_point;
-    /*
-    for(octomap::OcTree::leaf_bbx_iterator grad_it = tree->begin_leafs_bbx(start, end, maxDepth), bbx_end = tree->end_leafs_bbx(); grad_it != bbx_end; std::advance(grad_it,3))
-        {
-
-            MMD_Gradients upload_grad;
-
-
-            octomap::point3d grad_pt = grad_it.getCoordinate();
-
-            // std::cout << grad_pt.x() << std::endl;
-            convert_point_to_key( grad_pt  , key_x , key_y , key_z);
-            gradient_Vector_per_point = compute_gradients_MMD_map( grad_pt );
-
-            upload_grad.gradient_x = float( gradient_Vector_per_point.x());
-            upload_grad.gradient_y = float( gradient_Vector_per_point.y());
-            upload_grad.gradient_z = float( gradient_Vector_per_point.z());
-
-            MMD_grad_key upload_Key_data;
-
-            upload_Key_data.x_grad_key = key_x;
-            upload_Key_data.y_grad_key = key_y;
-            upload_Key_data.z_grad_key = key_z;
-
-            MMD_gradient_data[upload_Key_data]= upload_grad;
-
-    // std::cout << "************" << std::endl;
-
-
-    //  std::cout << "  " << gradient_Vector_per_point.x() << "  " << gradient_Vector_per_point.y() << " " << gradient_Vector_per_point.z() << std::endl;
-
-    // std::cout << "--------------" << std::endl;
-
-        }
-
-    */
 }
 
 octomap::point3d MMD_Map::MMD_Map_Functions::convertToOctomapPt(Eigen::Vector3d pt)
@@ -0,0 +1,72 @@
+/**
+ * Shared read-only store for the MMD feature weights (cco_mmd library)
+ *
+ * Every weight file is loaded once per process and shared by all the consumers (optimizer,
+ * A* search, MMD map). The binary format is memory mapped:
+ *
+ *     WeightFileHeader (32 bytes) | rows * cols float32, column major
+ *
+ * The header carries a magic, a version, the shape and an FNV-1a checksum of the payload,
+ * all of which are validated on load together with the file size and finite values.
+ * Binary files are produced from the existing CSV files with the convertWeights node.
+ * CSV paths are still accepted (parsed once and cached) so old launch files keep working.
+ **/
+#pragma once
+
+#include <Eigen/Dense>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace MMDFunctions
+{
+    struct WeightFileHeader
+    {
+        char magic[8]; // "CCOWGT\0\0"
+        uint32_t version;
+        uint32_t rows;
+        uint32_t cols;
+        uint32_t reserved;
+        uint64_t checksum; // FNV-1a of the payload bytes
+    };
+
+    class WeightStore
+    {
+    public:
+        static const uint32_t VERSION = 1;
+
+        /** shared store for path_to_weights, nullptr if the file is missing or fails validation **/
+        static std::shared_ptr<const WeightStore> load(const std::string &path_to_weights);
+
+        /** write the CSV weights in the binary format, returns false on a malformed CSV or a write error **/
+        static bool convert_csv(const std::string &csv_path, const std::string &binary_path);
+
+        int rows() const { return rows_; }
+        int cols() const { return cols_; }
+        Eigen::Map<const Eigen::MatrixXf> matrix() const { return Eigen::Map<const Eigen::MatrixXf>(data_, rows_, cols_); }
+
+        /** copy into weights if the shapes agree **/
+        bool assign_to(Eigen::Ref<Eigen::MatrixXf> weights) const;
+
+        ~WeightStore();
+        WeightStore(const WeightStore &) = delete;
+        WeightStore &operator=(const WeightStore &) = delete;
+
+    private:
+        WeightStore() = default;
+
+        static std::shared_ptr<WeightStore> map_binary(const std::string &path);
+        static std::shared_ptr<WeightStore> parse_csv(const std::string &path);
+
+        std::string path_;
+        int rows_ = 0;
+        int cols_ = 0;
+        const float *data_ = nullptr;
+
+        void *mapping_ = nullptr; // mmap of the whole binary file
+        size_t mapping_size_ = 0;
+        Eigen::MatrixXf owned_; // CSV fallback
+    };
+
+    uint64_t weights_checksum(const float *data, size_t count);
+}
@@ -5,6 +5,9 @@
 #pragma once
 
 #include "utils.h"
+#include "MMD_moments.h"
+#include "MMD_kernels.h"
+#include "map_snapshot.h"
 #include <random>
 #include <algorithm>
 #include <limits.h>
@@ -24,6 +27,7 @@ namespace Map3D
         double octree_resolution = 0.2;
         double resolution_factor = 1 / octree_resolution;
         octomap::OcTree *tree = new octomap::OcTree(octree_resolution); // convert to OcTree for EDT calculation
+        std::shared_ptr<octomap::OcTree> shared_tree{tree};              // owns tree, shared with the map snapshots built on it
         octomap::OcTree *MMD_tree = new octomap::OcTree(octree_resolution);
 
         octomap::point3d min, max;   // min, max of the map
@@ -54,13 +58,14 @@ namespace Map3D
         void setMapRange(Eigen::Vector3d pt);
         bool isInMap(octomap::point3d pt);
         void setMinMax();
+        void setTree(octomap::AbstractOcTree *msg_tree); // takes over a tree read from an octomap message
         void erase();
-        void getCostMapMarker(visualization_msgs::MarkerArray m, DynamicEDTOctomap *ptr, ros::Publisher pub);
-        void get_MMD_Map_Marker(visualization_msgs::MarkerArray m, DynamicEDTOctomap *ptr, ros::Publisher pub);
+        void getCostMapMarker(visualization_msgs::MarkerArray m, const MapSnapshot &map, ros::Publisher pub);
+        void get_MMD_Map_Marker(visualization_msgs::MarkerArray m, const MapSnapshot &map, ros::Publisher pub);
         void convert_point_to_key(octomap::point3d inpt, int &key_x, int &key_y, int &key_z);
         std::tuple<int, int, int> convert_point_to_key_external(octomap::point3d inPt);
         double compute_EDT_interpolation(float distance_at_query_point);
-        double compute_EDT_linear_transforms(Eigen::MatrixXf actual_distribution);
+        double compute_EDT_linear_transforms(const Eigen::MatrixXf &actual_distribution);
         void assign_weights();
 
         Eigen::Vector3d compute_gradients_MMD_map(octomap::point3d grad_pt);
@@ -199,11 +204,23 @@ Map3D::OctoMapEDT::OctoMapEDT()
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////
-/** delete the trees to save memory **/
+/** replace the tree, the previous one goes with the last map snapshot built on it **/
+void Map3D::OctoMapEDT::setTree(octomap::AbstractOcTree *msg_tree)
+{
+    std::shared_ptr<octomap::AbstractOcTree> owner(msg_tree);
+
+    new_tree = msg_tree;
+    shared_tree = std::dynamic_pointer_cast<octomap::OcTree>(owner);
+    tree = shared_tree.get();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////
+/** release the tree to save memory, snapshots keep theirs **/
 void Map3D::OctoMapEDT::erase()
 {
-    delete tree;
-    delete new_tree;
+    shared_tree.reset();
+    tree = NULL;
+    new_tree = NULL;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////
@@ -287,14 +304,14 @@ bool Map3D::OctoMapEDT::isInMap(octomap::point3d pt)
 
 //////////////////////////////////////////////////////////////////////////////////////////
 /** publish the costmap obtained from the octree **/
-void Map3D::OctoMapEDT::getCostMapMarker(visualization_msgs::MarkerArray m, DynamicEDTOctomap *ptr, ros::Publisher pub)
+void Map3D::OctoMapEDT::getCostMapMarker(visualization_msgs::MarkerArray m, const MapSnapshot &map, ros::Publisher pub)
 {
     unsigned char maxDepth = 16;
     uint32_t shape = visualization_msgs::Marker::CUBE;
     int count = 0;
 
     // set a bounding box using the start and end variables
-    for (octomap::OcTree::leaf_bbx_iterator it = tree->begin_leafs_bbx(start, end, maxDepth), bbx_end = tree->end_leafs_bbx(); it != bbx_end; std::advance(it, 3))
+    for (octomap::OcTree::leaf_bbx_iterator it = map.tree()->begin_leafs_bbx(map.start(), map.end(), maxDepth), bbx_end = map.tree()->end_leafs_bbx(); it != bbx_end; std::advance(it, 3))
     {
         // std::cout<<it.getCoordinate()<<std::endl;
         octomap::point3d pt = it.getCoordinate();
@@ -332,7 +349,7 @@ void Map3D::OctoMapEDT::getCostMapMarker(visualization_msgs::MarkerArray m, Dyna
         marker.scale.z = 0.30;
 
         // set the color of the cell based on the distance from the obstacle
-        float dist = ptr->getDistance(pt);
+        float dist = map.distance(pt);
 
         marker.color.r = (1 - dist / 10.0) * (1 - dist / 10.0);
         marker.color.g = std::sqrt(std::sqrt(dist / 10.0));
@@ -496,106 +513,16 @@ double Map3D::OctoMapEDT::compute_EDT_interpolation(float distance_at_query_poin
 
 void Map3D::OctoMapEDT::assign_weights()
 {
-    int rows = 100;
-    int cols = 5;
-    std::string file = "../src/CCO_VOXEL/include/CCO_VOXEL/weight.csv";
-    std::ifstream in(file);
-
-    std::string line;
-
-    int row = 0;
-    int col = 0;
-
-    Eigen::MatrixXf res = Eigen::MatrixXf(rows, cols);
-
-    if (in.is_open())
-    {
-
-        while (std::getline(in, line))
-        {
-
-            char *ptr = (char *)line.c_str();
-            int len = line.length();
-
-            col = 0;
-
-            char *start = ptr;
-            for (int i = 0; i < len; i++)
-            {
-
-                if (ptr[i] == ',')
-                {
-                    res(row, col++) = atof(start);
-                    start = ptr + i + 1;
-                }
-            }
-            res(row, col) = atof(start);
-
-            row++;
-        }
-
-        in.close();
-    }
-
-    Weights = res;
-
-    std::cout << Weights.rows() << " " << Weights.cols() << std::endl;
+    MMDFunctions::load_weights("../src/CCO_VOXEL/include/CCO_VOXEL/weight.csv", Weights);
 }
 
-double Map3D::OctoMapEDT::compute_EDT_linear_transforms(Eigen::MatrixXf actual_distribution)
+double Map3D::OctoMapEDT::compute_EDT_linear_transforms(const Eigen::MatrixXf &actual_distribution)
 {
 
-    Eigen::MatrixXf transformed_features(1, 5);
-
-    transformed_features = actual_distribution * Weights;
-
-    // std::cout << transformed_features << std::endl;
-
-    int num_samples_of_distance_distribution = transformed_features.cols();
-    Eigen::MatrixXf squared_dist(1, num_samples_of_distance_distribution);
-    Eigen::MatrixXf temp(1, num_samples_of_distance_distribution);
-    Eigen::MatrixXf alpha_weights(1, num_samples_of_distance_distribution);
-
-    alpha_weights.setOnes();
-
-    // temp = actual_distribution.array();
-
-    squared_dist = (transformed_features.array()).square();
-
-    Eigen::MatrixXf kernel_matrix1(num_samples_of_distance_distribution, num_samples_of_distance_distribution);
-    Eigen::MatrixXf temp_kernel_matrix1(num_samples_of_distance_distribution, num_samples_of_distance_distribution);
-    Eigen::MatrixXf temp_kernel_matrix2(num_samples_of_distance_distribution, num_samples_of_distance_distribution);
-
-    Eigen::MatrixXf One_matrix(num_samples_of_distance_distribution, num_samples_of_distance_distribution);
-    One_matrix.setOnes();
-
-    // std::cout << " Entered the main funciton /////////////" << std::endl;
-    temp_kernel_matrix1 = transformed_features.transpose() * transformed_features;
-
-    temp_kernel_matrix2 = squared_dist.transpose() * squared_dist;
-
-    kernel_matrix1 = One_matrix + 2 * temp_kernel_matrix1 + temp_kernel_matrix2;
-
-    Eigen::Matrix<float, 1, 1> res;
-    Eigen::Matrix<float, 1, 1> res1;
-    Eigen::Matrix<float, 1, 1> res2;
-    Eigen::Matrix<float, 1, 1> res3;
-
-    float temp_value = 0;
-
-    double res_val;
-    res1 = alpha_weights * kernel_matrix1 * (alpha_weights.transpose());
-
-    res2(0, 0) = num_samples_of_distance_distribution;
-    res3(0, 0) = num_samples_of_distance_distribution;
-
-    res(0, 0) = res1(0, 0) - 2 * res2(0, 0) + res3(0, 0);
-    res_val = double(res(0, 0));
-
-    return res_val;
+    return double(MMDFunctions::transformed_MMD(actual_distribution, Weights));
 }
 
-void Map3D::OctoMapEDT::get_MMD_Map_Marker(visualization_msgs::MarkerArray mdd_marker, DynamicEDTOctomap *ptr, ros::Publisher MMD_map_pub)
+void Map3D::OctoMapEDT::get_MMD_Map_Marker(visualization_msgs::MarkerArray mdd_marker, const MapSnapshot &map, ros::Publisher MMD_map_pub)
 {
 
     unsigned char maxDepth = 16;
@@ -624,7 +551,7 @@ void Map3D::OctoMapEDT::get_MMD_Map_Marker(visualization_msgs::MarkerArray mdd_m
         noise_distribution(0, i) = radius(0, i) - float(noise(gen));
     }
 
-    for (octomap::OcTree::leaf_bbx_iterator it = tree->begin_leafs_bbx(start, end, maxDepth), bbx_end = tree->end_leafs_bbx(); it != bbx_end; std::advance(it, 3))
+    for (octomap::OcTree::leaf_bbx_iterator it = map.tree()->begin_leafs_bbx(map.start(), map.end(), maxDepth), bbx_end = map.tree()->end_leafs_bbx(); it != bbx_end; std::advance(it, 3))
     {
 
         // std::cout<<it.getCoordinate()<<std::endl;
@@ -678,7 +605,7 @@ void Map3D::OctoMapEDT::get_MMD_Map_Marker(visualization_msgs::MarkerArray mdd_m
         marker.scale.z = 0.30;
 
         // set the color of the cell based on the distance from the obstacle
-        float dist = ptr->getDistance(pt);
+        float dist = map.distance(pt);
         float MMD_val = 0;
 
         double threshold_val = 0.75 - (dist - 2);
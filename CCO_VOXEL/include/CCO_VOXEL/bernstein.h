@@ -18,12 +18,12 @@ namespace Bernstein
 
         inline void generateCoeffMatrices(int numWayPts, float execTime);                                                                              // generate coefficient matrices (P, Pdot, Pddot)
         inline void generateTrajCoeffs(std::vector<Eigen::Vector3d> waypts);                                                                           // generate the initial coefficients using fastplanner waypoints
-        inline std::vector<Eigen::MatrixXd> generatePerturbedCoeffs(int numSamples, std::vector<Eigen::Vector3d> coeffs_, Eigen::Vector3d var_vector); // generate perturbed coefficients using the current coefficients
+        inline std::vector<Eigen::MatrixXd> generatePerturbedCoeffs(int numSamples, std::vector<Eigen::Vector3d> coeffs_, Eigen::Vector3d var_vector, unsigned int seed = 0); // generate perturbed coefficients using the current coefficients, seed 0 uses the time
 
     private:
         inline double binomial(int n, int r);
         double factorial(int n);
-        inline std::vector<Eigen::MatrixXd> generateRandomCoeffs(int numSamples, std::vector<Eigen::Vector3d> coeffs_, Eigen::Vector3d var_vector); // returns vector of 3 matrices of 100x11(for x,y and z)
+        inline std::vector<Eigen::MatrixXd> generateRandomCoeffs(int numSamples, std::vector<Eigen::Vector3d> coeffs_, Eigen::Vector3d var_vector, unsigned int seed); // returns vector of 3 matrices of 100x11(for x,y and z)
                                                                                                                                                     // std::vector<Eigen::MatrixXd> perturb_coefficeints_of_mean_trajectory( int numSamples, std::vector<Eigen::Vector3d> mean_coeff,  Eigen::Vector3d var_vector );
     };
 
@@ -249,9 +249,9 @@ inline void Bernstein::BernsteinPath::generateTrajCoeffs(std::vector<Eigen::Vect
 /*********************************************
  * Function to generate random coefficients  *
  **********************************************/
-inline std::vector<Eigen::MatrixXd> Bernstein::BernsteinPath::generatePerturbedCoeffs(int numSamples, std::vector<Eigen::Vector3d> wayPts, Eigen::Vector3d var_vector)
+inline std::vector<Eigen::MatrixXd> Bernstein::BernsteinPath::generatePerturbedCoeffs(int numSamples, std::vector<Eigen::Vector3d> wayPts, Eigen::Vector3d var_vector, unsigned int seed)
 {
-    std::vector<Eigen::MatrixXd> perturbedCoeffs = generateRandomCoeffs(numSamples, wayPts, var_vector);
+    std::vector<Eigen::MatrixXd> perturbedCoeffs = generateRandomCoeffs(numSamples, wayPts, var_vector, seed);
 
     // now set the initial and final coordinates of each sample equal to that of initial wayPts
     return perturbedCoeffs;
@@ -290,9 +290,9 @@ double Bernstein::BernsteinPath::factorial(int n)
 /*******************************************
  * Function to generate random trajectories *
  ********************************************/
-inline std::vector<Eigen::MatrixXd> Bernstein::BernsteinPath::generateRandomCoeffs(int numSamples, std::vector<Eigen::Vector3d> coefficients, Eigen::Vector3d var_vector)
+inline std::vector<Eigen::MatrixXd> Bernstein::BernsteinPath::generateRandomCoeffs(int numSamples, std::vector<Eigen::Vector3d> coefficients, Eigen::Vector3d var_vector, unsigned int seed)
 {
-    std::default_random_engine de(time(0));
+    std::default_random_engine de(seed != 0 ? seed : time(0));
 
     std::vector<Eigen::MatrixXd> perturbCoeffs;
 
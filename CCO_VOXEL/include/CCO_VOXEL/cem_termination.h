@@ -0,0 +1,156 @@
+/**
+ * Termination of the cross entropy optimizer
+ *
+ * The optimizer still runs at most numIterations, but stops earlier once
+ *   VARIANCE_CONVERGED  the largest sampling stddev is below variance_threshold
+ *   COST_STALLED        the best cost improved by less than relative_improvement (relative to the
+ *                       previous best) for stall_iterations iterations in a row
+ *   ELITES_STABLE       at least elite_stability of the carried over elites of the previous
+ *                       iteration are elites again, stall_iterations times in a row
+ *   TIME_BUDGET         (anytime mode, time_budget_ms > 0) the next iteration would end after the
+ *                       budget, predicted from the slowest iteration so far. The budget runs from
+ *                       start(), or from the given start of the enclosing call (the modes of a
+ *                       multi-modal plan share the budget of the parent)
+ * none of the criteria fire before min_iterations. A threshold <= 0 disables its criterion, the
+ * defaults only keep MAX_ITERATIONS so the planner behaves as before unless configured.
+ **/
+#pragma once
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace Optimizer
+{
+    class TerminationCriteria
+    {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        enum StopReason
+        {
+            MAX_ITERATIONS,
+            VARIANCE_CONVERGED,
+            COST_STALLED,
+            ELITES_STABLE,
+            TIME_BUDGET
+        };
+
+        double variance_threshold = 0;   // stddev of the free coefficients
+        double relative_improvement = 0; // of the best cost, e.g. 0.01 for 1%
+        double elite_stability = 0;      // fraction of carried over elites that stay elites, in (0, 1]
+        int stall_iterations = 2;
+        int min_iterations = 1;
+        double time_budget_ms = 0; // wall clock budget of one optimizeTrajectory call
+
+        /** start of an optimizeTrajectory call **/
+        void start();
+        /** start of a call whose time budget began at budget_start **/
+        void start(Clock::time_point budget_start);
+
+        /**
+         * Records iteration iter (0 based) and returns whether the optimizer should stop.
+         * best_cost is the best cost found so far, stddev the sampling stddev per axis after the
+         * update and carried_elites / num_carried how many of the carried over elites of the
+         * previous iteration are elites again.
+         **/
+        bool update(int iter, double best_cost, const Eigen::Vector3d &stddev, int carried_elites, int num_carried);
+
+        StopReason stop_reason() const { return reason; }
+        int iterations() const { return num_iterations; }
+        double elapsed_ms() const;
+        double remaining_ms() const; // of the time budget, infinite without one
+        Clock::time_point started_at() const { return start_time; }
+
+        static const char *to_string(StopReason reason);
+
+    private:
+        Clock::time_point start_time, iteration_start;
+        double slowest_iteration_ms = 0;
+        double prev_best_cost = std::numeric_limits<double>::infinity();
+        int stalled = 0;
+        int stable = 0;
+        int num_iterations = 0;
+        StopReason reason = MAX_ITERATIONS;
+    };
+}
+
+inline void Optimizer::TerminationCriteria::start()
+{
+    start(Clock::now());
+}
+
+inline void Optimizer::TerminationCriteria::start(Clock::time_point budget_start)
+{
+    start_time = budget_start;
+    iteration_start = Clock::now();
+    slowest_iteration_ms = 0;
+    prev_best_cost = std::numeric_limits<double>::infinity();
+    stalled = 0;
+    stable = 0;
+    num_iterations = 0;
+    reason = MAX_ITERATIONS;
+}
+
+inline double Optimizer::TerminationCriteria::elapsed_ms() const
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start_time).count();
+}
+
+inline double Optimizer::TerminationCriteria::remaining_ms() const
+{
+    return time_budget_ms > 0 ? time_budget_ms - elapsed_ms() : std::numeric_limits<double>::infinity();
+}
+
+inline bool Optimizer::TerminationCriteria::update(int iter, double best_cost, const Eigen::Vector3d &stddev, int carried_elites, int num_carried)
+{
+    Clock::time_point now = Clock::now();
+    slowest_iteration_ms = std::max(slowest_iteration_ms, std::chrono::duration<double, std::milli>(now - iteration_start).count());
+    iteration_start = now;
+    num_iterations = iter + 1;
+
+    // a first finite cost always counts as an improvement
+    bool improved = !std::isfinite(prev_best_cost) || prev_best_cost - best_cost > relative_improvement * std::abs(prev_best_cost);
+    stalled = improved ? 0 : stalled + 1;
+    prev_best_cost = std::min(prev_best_cost, best_cost);
+
+    bool carried_stable = num_carried > 0 && carried_elites >= elite_stability * num_carried;
+    stable = carried_stable ? stable + 1 : 0;
+
+    if (num_iterations < min_iterations)
+        return false;
+
+    if (variance_threshold > 0 && stddev.maxCoeff() < variance_threshold)
+        reason = VARIANCE_CONVERGED;
+    else if (relative_improvement > 0 && stalled >= stall_iterations)
+        reason = COST_STALLED;
+    else if (elite_stability > 0 && stable >= stall_iterations)
+        reason = ELITES_STABLE;
+    else if (time_budget_ms > 0 && elapsed_ms() + slowest_iteration_ms > time_budget_ms)
+        reason = TIME_BUDGET;
+    else
+        return false;
+
+    return true;
+}
+
+inline const char *Optimizer::TerminationCriteria::to_string(StopReason reason)
+{
+    switch (reason)
+    {
+    case VARIANCE_CONVERGED:
+        return "variance converged";
+    case COST_STALLED:
+        return "cost stalled";
+    case ELITES_STABLE:
+        return "elites stable";
+    case TIME_BUDGET:
+        return "time budget";
+    default:
+        return "max iterations";
+    }
+}
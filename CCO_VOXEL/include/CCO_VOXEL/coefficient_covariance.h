@@ -0,0 +1,143 @@
+/**
+ * Full / banded covariance sampling of the Bernstein coefficients
+ *
+ * Replaces the isotropic perturbation of generatePerturbedCoeffs (one stddev per axis) by a
+ * Gaussian with a covariance over the free coefficients of each axis (the first and last three
+ * are pinned to the boundary conditions and copied from the mean). Samples are
+ *   x = mean + L z,  z ~ N(0, I) from the (replan, iteration, sample, stream / axis) CEM_COEFFS stream
+ * with L the Cholesky factor cached at the last update. update() fits the covariance to the
+ * weighted elites, keeps the entries within bandwidth of the diagonal (-1 keeps all of them,
+ * 0 gives a diagonal covariance), raises the variances to min_stddev^2 and refactors; a band
+ * that is not positive definite gets a growing diagonal shift until it is.
+ **/
+#pragma once
+
+#include "elite_selection.h"
+#include "philox_rng.h"
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace Optimizer
+{
+    class CoefficientCovariance
+    {
+    public:
+        static constexpr int PINNED = 3; // coefficients pinned at each end
+
+        bool enabled = false;
+        int bandwidth = -1;
+        uint32_t stream_id = 0; // independent draws for every mode of the multi-modal optimizer
+
+        /** isotropic start, stddev per axis, over num_coeffs coefficients **/
+        void reset(int num_coeffs, const Eigen::Vector3d &stddev);
+
+        /** num_samples x num_coeffs coefficients per axis around mean (num_coeffs x 3) **/
+        void sample(const Eigen::MatrixXd &mean, int num_samples, uint32_t epoch, int iteration, std::vector<Eigen::MatrixXd> &samples);
+
+        /** refit axis to the elites of samples (num_samples x num_coeffs) around their weighted mean **/
+        void update(int axis, const Eigen::MatrixXd &samples, const Eigen::RowVectorXd &mean, const EliteSelection &elites, double min_stddev);
+
+        /** root mean variance of the free coefficients of an axis **/
+        double stddev(int axis) const { return std::sqrt(covariance[axis].diagonal().mean()); }
+
+    private:
+        void factorize(int axis);
+
+        Eigen::MatrixXd covariance[3];
+        Eigen::MatrixXd cholesky[3]; // lower
+        Eigen::MatrixXd centered;    // scratch of update, elites x free
+        Eigen::VectorXf noise;       // scratch of sample
+    };
+}
+
+inline void Optimizer::CoefficientCovariance::reset(int num_coeffs, const Eigen::Vector3d &stddev)
+{
+    int num_free = std::max(0, num_coeffs - 2 * PINNED);
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        covariance[axis] = Eigen::MatrixXd::Identity(num_free, num_free) * (stddev(axis) * stddev(axis));
+        cholesky[axis] = Eigen::MatrixXd::Identity(num_free, num_free) * stddev(axis);
+    }
+}
+
+inline void Optimizer::CoefficientCovariance::sample(const Eigen::MatrixXd &mean, int num_samples, uint32_t epoch, int iteration, std::vector<Eigen::MatrixXd> &samples)
+{
+    int num_coeffs = int(mean.rows());
+    int num_free = int(cholesky[0].rows());
+
+    samples.resize(3);
+    noise.resize(num_free);
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        samples[axis].resize(num_samples, num_coeffs);
+        samples[axis].rowwise() = mean.col(axis).transpose();
+
+        for (int s = 0; s < num_samples; s++)
+        {
+            RandomStreams::Stream(RandomStreams::CEM_COEFFS, epoch, uint32_t(iteration), uint32_t(s), uint32_t(3 * stream_id + axis)).fill_normal(noise.data(), num_free, 0.0f, 1.0f);
+
+            samples[axis].row(s).segment(PINNED, num_free) += (cholesky[axis].triangularView<Eigen::Lower>() * noise.cast<double>()).transpose();
+        }
+    }
+}
+
+inline void Optimizer::CoefficientCovariance::update(int axis, const Eigen::MatrixXd &samples, const Eigen::RowVectorXd &mean, const EliteSelection &elites, double min_stddev)
+{
+    int num_free = int(covariance[axis].rows());
+    int num_elites = int(elites.indices.size());
+
+    // rows scaled by sqrt(w) so that the weighted covariance is one product
+    centered.resize(num_elites, num_free);
+
+    for (int i = 0; i < num_elites; i++)
+    {
+        centered.row(i) = std::sqrt(elites.weights(i)) * (samples.row(elites.indices[i]).segment(PINNED, num_free) - mean.segment(PINNED, num_free));
+    }
+
+    covariance[axis].noalias() = centered.transpose() * centered;
+
+    if (bandwidth >= 0)
+    {
+        for (int r = 0; r < num_free; r++)
+        {
+            for (int c = 0; c < num_free; c++)
+            {
+                if (std::abs(r - c) > bandwidth)
+                    covariance[axis](r, c) = 0;
+            }
+        }
+    }
+
+    covariance[axis].diagonal() = covariance[axis].diagonal().cwiseMax(min_stddev * min_stddev);
+
+    factorize(axis);
+}
+
+inline void Optimizer::CoefficientCovariance::factorize(int axis)
+{
+    Eigen::MatrixXd &cov = covariance[axis];
+    double shift = 1e-9 * std::max(1.0, cov.diagonal().maxCoeff());
+
+    for (int attempt = 0; attempt < 20; attempt++)
+    {
+        Eigen::LLT<Eigen::MatrixXd> llt(cov);
+
+        if (llt.info() == Eigen::Success)
+        {
+            cholesky[axis] = llt.matrixL();
+            return;
+        }
+
+        cov.diagonal().array() += shift;
+        shift *= 10;
+    }
+
+    // never reached for a finite covariance, keep the variances only
+    cov = Eigen::MatrixXd(cov.diagonal().asDiagonal());
+    cholesky[axis] = Eigen::MatrixXd(cov.diagonal().cwiseSqrt().asDiagonal());
+}
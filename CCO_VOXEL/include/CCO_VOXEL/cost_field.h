@@ -0,0 +1,146 @@
+/**
+ * Trilinear collision cost field over a map snapshot
+ *
+ * The cost of a waypoint is a function of its EDT distance alone (cost_of_distance, e.g. the
+ * tabulated MMD), so the field stores that cost at the nodes of a regular grid over the snapshot
+ * window and interpolates it trilinearly in between; value() returns the interpolant and its
+ * analytic gradient, which is what the gradient based backend descends. Nodes are filled lazily
+ * on first use (a trajectory touches a thin tube of the window); a node is an atomic, so one
+ * field, kept in the map snapshot (MapSnapshot::derived), serves every mode of the optimizer at
+ * once and a node filled twice gets the same value. Outside the window the point is clamped onto
+ * it and the gradient across the border is zero. The field must not outlive its snapshot.
+ **/
+#pragma once
+
+#include "map_snapshot.h"
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <vector>
+
+namespace Map3D
+{
+    class CostField
+    {
+    public:
+        typedef std::function<float(float distance)> CostOfDistance;
+
+        /** grid of the given resolution over the window of map, every node to be filled again **/
+        void reset(const MapSnapshot &map, double resolution, CostOfDistance cost_of_distance);
+
+        /** interpolated cost at pt, and its gradient when gradient is not null **/
+        double value(const Eigen::Vector3d &pt, Eigen::Vector3d *gradient = nullptr) const;
+
+        int filled() const { return num_filled.load(std::memory_order_relaxed); } // nodes filled since reset()
+
+    private:
+        float node(int i, int j, int k) const;
+
+        const MapSnapshot *map = nullptr;
+        CostOfDistance cost_of_distance;
+        Eigen::Vector3d origin;
+        double resolution = 0.2;
+        int dims[3] = {0, 0, 0};
+        mutable std::vector<std::atomic<float>> nodes; // NaN until filled, x fastest
+        mutable std::atomic<int> num_filled{0};
+    };
+}
+
+inline void Map3D::CostField::reset(const MapSnapshot &map_, double resolution_, CostOfDistance cost_of_distance_)
+{
+    map = &map_;
+    cost_of_distance = std::move(cost_of_distance_);
+    resolution = resolution_ > 0 ? resolution_ : 0.2;
+    origin = Eigen::Vector3d(map->start().x(), map->start().y(), map->start().z());
+
+    Eigen::Vector3d extent = Eigen::Vector3d(map->end().x(), map->end().y(), map->end().z()) - origin;
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        dims[axis] = std::max(2, int(std::ceil(extent(axis) / resolution)) + 1);
+    }
+
+    nodes = std::vector<std::atomic<float>>(size_t(dims[0]) * dims[1] * dims[2]);
+
+    for (std::atomic<float> &cost : nodes)
+        cost.store(std::numeric_limits<float>::quiet_NaN(), std::memory_order_relaxed);
+
+    num_filled = 0;
+}
+
+inline float Map3D::CostField::node(int i, int j, int k) const
+{
+    std::atomic<float> &node_cost = nodes[(size_t(k) * dims[1] + j) * dims[0] + i];
+    float cost = node_cost.load(std::memory_order_relaxed);
+
+    if (std::isnan(cost))
+    {
+        octomap::point3d pt(origin.x() + i * resolution, origin.y() + j * resolution, origin.z() + k * resolution);
+
+        // nodes on the far border may lie just outside the window, where the EDT is negative
+        cost = cost_of_distance(std::max(0.0f, map->distance(pt)));
+        node_cost.store(cost, std::memory_order_relaxed);
+        num_filled.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    return cost;
+}
+
+inline double Map3D::CostField::value(const Eigen::Vector3d &pt, Eigen::Vector3d *gradient) const
+{
+    int cell[3];
+    double t[3];
+    bool inside[3];
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        double f = (pt(axis) - origin(axis)) / resolution;
+        double clamped = std::min(std::max(f, 0.0), double(dims[axis] - 1));
+
+        inside[axis] = f == clamped;
+        cell[axis] = std::min(int(std::floor(clamped)), dims[axis] - 2);
+        t[axis] = clamped - cell[axis];
+    }
+
+    double c[2][2][2];
+
+    for (int dk = 0; dk < 2; dk++)
+        for (int dj = 0; dj < 2; dj++)
+            for (int di = 0; di < 2; di++)
+                c[dk][dj][di] = node(cell[0] + di, cell[1] + dj, cell[2] + dk);
+
+    // along x, then y, then z
+    double cy[2][2], cz[2];
+
+    for (int dk = 0; dk < 2; dk++)
+        for (int dj = 0; dj < 2; dj++)
+            cy[dk][dj] = c[dk][dj][0] + t[0] * (c[dk][dj][1] - c[dk][dj][0]);
+
+    for (int dk = 0; dk < 2; dk++)
+        cz[dk] = cy[dk][0] + t[1] * (cy[dk][1] - cy[dk][0]);
+
+    if (gradient)
+    {
+        double dx[2][2], dy[2];
+
+        for (int dk = 0; dk < 2; dk++)
+            for (int dj = 0; dj < 2; dj++)
+                dx[dk][dj] = c[dk][dj][1] - c[dk][dj][0];
+
+        for (int dk = 0; dk < 2; dk++)
+            dy[dk] = cy[dk][1] - cy[dk][0];
+
+        double gx0 = dx[0][0] + t[1] * (dx[0][1] - dx[0][0]);
+        double gx1 = dx[1][0] + t[1] * (dx[1][1] - dx[1][0]);
+
+        (*gradient)(0) = inside[0] ? (gx0 + t[2] * (gx1 - gx0)) / resolution : 0.0;
+        (*gradient)(1) = inside[1] ? (dy[0] + t[2] * (dy[1] - dy[0])) / resolution : 0.0;
+        (*gradient)(2) = inside[2] ? (cz[1] - cz[0]) / resolution : 0.0;
+    }
+
+    return cz[0] + t[2] * (cz[1] - cz[0]);
+}
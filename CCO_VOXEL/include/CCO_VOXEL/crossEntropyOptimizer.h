@@ -10,8 +10,26 @@
 #include "bernstein.h"
 #include "bsplineNonUnif.h"
 #include "Map.h"
+#include "map_snapshot.h"
+#include "MMD_lookup_table.h"
+#include "qmc_noise.h"
+#include "worker_pool.h"
+#include "elite_selection.h"
+#include "elite_archive.h"
+#include "coefficient_covariance.h"
+#include "rollout_buffer.h"
+#include "rollout_costs.h"
+#include "rollout_screening.h"
+#include "cem_termination.h"
+#include "warm_start.h"
+#include "sample_schedule.h"
+#include "telemetry.h"
+#include "homotopy_seeds.h"
+#include "gradient_optimizer.h"
+#include "cost_field.h"
 #include <random>
 #include <algorithm>
+#include <memory>
 #include "visulization.h"
 #include <fstream>
 #include <filesystem>
@@ -34,23 +52,95 @@ namespace Optimizer
         std::string path_to_weights2;
         CrossEntropyOptimizer();
         CrossEntropyOptimizer(int numIterations_);
-        std::vector<Eigen::Vector3d> optimizeTrajectory(Bernstein::BernsteinPath bTraj, std::vector<Eigen::Vector3d> wayPts, float execTime, Map3D::OctoMapEDT costMap3D, ros::Publisher sample_trajectory_pub,
+        std::vector<Eigen::Vector3d> optimizeTrajectory(Bernstein::BernsteinPath bTraj, std::vector<Eigen::Vector3d> wayPts, float execTime, const Map3D::MapSnapshotPtr &map, ros::Publisher sample_trajectory_pub,
                                                         ros::Publisher plan_dur_pub, std::string path_to_weights);
-        double costPerTrajectory(std::vector<Eigen::Vector3d> trajectory, std::vector<Eigen::Vector3d> trajectoryAcc, std::vector<Eigen::Vector3d> initTrajectory, Map3D::OctoMapEDT costMap3D, bool is_mean,
-                                 ros::Publisher plan_dur_pub);
+        void build_mmd_table(const Map3D::MapSnapshot &map);
+        std::string mmd_table_key() const; // settings mmd_table depends on, its key in the map snapshot
         double get_variance(Eigen::MatrixXd one_dimension_trajectory, int iter);
-        double get_acc_cost(Eigen::Vector3d acc_in);
-        double get_elastic_band_cost(std::vector<Eigen::Vector3d> traj_in);
         double mmdPerPoint_interpolation(float distance);
-        float mmdPerPoint_transforms(Eigen::MatrixXf actual_distribution);
+        float mmdPerPoint_transforms(const Eigen::MatrixXf &actual_distribution);
         void assign_weights();
-        float MMD_transformed_features_RBF(Eigen::MatrixXf actual_distribution);
-        float RBF_kernel(float val1, float val2);
-        double get_total_smoothness_cost(std::vector<Eigen::Vector3d> optimTraj, float execTime);
+        float MMD_transformed_features_RBF(const Eigen::MatrixXf &actual_distribution);
 
         Eigen::Matrix<float, 100, 5> Weights;
         std::ofstream dist_measurments;
 
+        int number_of_points_in_distribution = 100;
+
+        // sample rollouts of an iteration in rows [0, samples), the mean trajectory in the last row (numSampleTrajs)
+        RolloutBuffer rollouts;
+        RolloutCosts rollout_costs; // stability and elastic band of every row of rollouts
+
+        // buffers of one rollout, one set per worker, reused across rollouts and iterations
+        struct RolloutScratch
+        {
+            Eigen::RowVectorXf edtDist;    // sampled distances of one waypoint
+            Eigen::MatrixXf distributions; // near-obstacle waypoints of the rollout
+            MMDFunctions::MMDBatchScratch mmd; // transformed features and MMDs of the rows of distributions
+        };
+
+        double costPerTrajectory(int rollout, const Map3D::MapSnapshot &map, RolloutScratch &scratch, int iteration, int sample, bool is_mean, CollisionModel model);
+
+        // model the elites are ranked by, full fidelity when the rollouts are screened
+        CollisionModel rankingModel() const { return use_mmd_lut && !screening.enabled ? TABULATED_MMD : SAMPLED_MMD; }
+
+        RolloutScreening screening; // proxy costs for all rollouts, the full MMD for the contenders only
+        int screenedRollouts = 0;   // rollouts of the last call that only got the proxy cost
+        std::vector<double> proxyCosts;
+        void screenRollouts(std::vector<double> &costTrajs, int first, int num_samples, int num_elites, int iteration, const Map3D::MapSnapshot &map);
+
+        EliteSelection elites;   // weighting / temperature of the elites, set from the Planner params
+        double min_stddev = 0.1; // floor of the sampling stddev of the free coefficients
+
+        EliteArchive elite_archive; // elites carried into the next iteration with their costs, valid while the map snapshot is
+
+        CoefficientCovariance covariance; // full / banded covariance sampling instead of one stddev per axis
+
+        TerminationCriteria termination; // early stop / anytime budget, stop reason of the last call
+        double bestCost = 0;             // cost of optimTrajCoeffs, the best rollout of the last call
+
+        WarmStart warm_start; // mean and elites of the last plan, shifted to seed the next one
+        void resetWarmStart();  // of this optimizer and of every mode, e.g. on a new goal
+
+        SampleSchedule sample_schedule; // rollouts / elites per iteration, numSampleTrajs / topSamples at most
+        int totalRollouts = 0;          // sample rollouts costed by the last call
+        int cachedRollouts = 0;         // archived elites that joined the selection of the last call without being costed
+
+        Telemetry::Sink telemetry;   // distances of the mean trajectory and elite rollouts, published off the planning thread
+        double telemetry_rate = 10.0; // [Hz]
+        bool publish_telemetry = true;
+
+        // multi-modal CEM: num_modes independent distributions seeded from lateral offsets of the A* path
+        int num_modes = 1;
+        double mode_offset = 1.5; // [m] lateral offset of the first ring of seeds, see homotopy_seeds.h
+        uint32_t mode_index = 0;  // of this optimizer when it runs as one of the modes
+        bool shares_budget = false;                          // set on the modes, their time budget runs from budget_start
+        TerminationCriteria::Clock::time_point budget_start; // start of the parent optimizeModes call
+        int winning_mode = 0;     // of the last call
+        std::vector<std::unique_ptr<CrossEntropyOptimizer>> modes;
+
+        std::vector<Eigen::Vector3d> optimizeModes(const Bernstein::BernsteinPath &bTraj, const std::vector<Eigen::Vector3d> &wayPts, float execTime, const Map3D::MapSnapshotPtr &map, ros::Publisher sample_trajectory_pub,
+                                                   ros::Publisher plan_dur_pub, const std::string &path_to_weights);
+        void copySettings(const CrossEntropyOptimizer &other);
+
+        // gradient backend: polish the best CEM rollout, or replace CEM, with L-BFGS on the cost field
+        Backend backend = CEM;
+        double min_cem_budget_ms = 0; // time budgets below this skip CEM for L-BFGS alone, 0 never does
+        GradientOptimizer gradient;
+        void polishTrajectory(const Bernstein::BernsteinPath &bTraj, float execTime, const Map3D::MapSnapshot &map);
+        void startTelemetry(ros::Publisher sample_trajectory_pub, ros::Publisher plan_dur_pub);
+
+        int num_threads = 0; // rollout workers, 0 uses every hardware thread
+        std::shared_ptr<Parallel::WorkerPool> worker_pool;
+        std::vector<RolloutScratch> rollout_scratch;
+
+        bool use_mmd_lut = false; // rank the rollouts by mmd_table, the expected MMD of the distance, instead of sampling a distribution per waypoint
+        int mmd_table_draws = 32; // noise draws averaged into every entry of mmd_table
+        MMDFunctions::KernelType mmd_kernel = MMDFunctions::POLYNOMIAL_KERNEL;
+        uint32_t replan_count = 0; // epoch of the random streams, one per call to optimizeTrajectory
+        RandomStreams::NoiseSampling noise_sampling = RandomStreams::PSEUDO_RANDOM; // how the distance noise is drawn, see qmc_noise.h
+        std::shared_ptr<const MMDFunctions::MMD_lookup_table> mmd_table; // of the last map snapshot, shared with the other modes
+
     private:
         inline double mmdPerPoint(std::vector<double> actualDistribution, std::vector<double> idealDistribution, std::vector<double> weights, int numEdtSamples);
         inline Eigen::MatrixXd convertVecTrajToMatTraj(std::vector<Eigen::Vector3d> arr);
@@ -78,42 +168,22 @@ Optimizer::CrossEntropyOptimizer::CrossEntropyOptimizer(int numIterations_)
     numIterations = numIterations_;
 }
 
-double Optimizer::CrossEntropyOptimizer::get_total_smoothness_cost(std::vector<Eigen::Vector3d> optimTraj, float execTime)
-{
-
-    float time = 0;
-    int num_waypts = optimTraj.size();
-    float delta_t = execTime / num_waypts;
-    double integral_jerk_cost = 0;
-    float prev_t = 0;
-    for (int i = 1; i < num_waypts; i++)
-    {
-        time = (float(i) / float(num_waypts - 1)) * execTime;
-        // std::cout << time <<std::endl;
-        delta_t = time - prev_t;
-        Eigen::Vector3d pt_prev;
-        Eigen::Vector3d pt_now;
-
-        pt_prev = optimTraj.at(i - 1);
-        pt_now = optimTraj.at(i);
-
-        float length = (pt_prev - pt_now).norm();
-
-        integral_jerk_cost += std::pow(length, 2) / (std::pow(time, 5));
-        prev_t = time;
-    }
-
-    integral_jerk_cost = integral_jerk_cost;
-
-    return integral_jerk_cost;
-}
-
 /*****************************
  * main optimizer function    *
  ******************************/
-std::vector<Eigen::Vector3d> Optimizer::CrossEntropyOptimizer::optimizeTrajectory(Bernstein::BernsteinPath bTraj, std::vector<Eigen::Vector3d> wayPts, float execTime, Map3D::OctoMapEDT costMap3D, ros::Publisher sample_trajectory_pub,
+std::vector<Eigen::Vector3d> Optimizer::CrossEntropyOptimizer::optimizeTrajectory(Bernstein::BernsteinPath bTraj, std::vector<Eigen::Vector3d> wayPts, float execTime, const Map3D::MapSnapshotPtr &map, ros::Publisher sample_trajectory_pub,
                                                                                   ros::Publisher plan_dur_pub, std::string path_to_weights)
 {
+    if (num_modes > 1)
+    {
+        return optimizeModes(bTraj, wayPts, execTime, map, sample_trajectory_pub, plan_dur_pub, path_to_weights);
+    }
+
+    if (shares_budget)
+        termination.start(budget_start);
+    else
+        termination.start();
+
     // generate the initial set of coefficients
     std::cout << "----Generating bernstein trajectory for " << wayPts.size() << " points" << std::endl;
     std::vector<Eigen::Vector3d> prev_mean_bernstein_trajectory;
@@ -123,301 +193,297 @@ std::vector<Eigen::Vector3d> Optimizer::CrossEntropyOptimizer::optimizeTrajector
 
     Eigen::MatrixXd initCoeff = convertVecTrajToMatTraj(bTraj.coeffs); // this takes in a vector of 11 indices and returns a matrix of size ptsPerTrajx3
 
-    Eigen::MatrixXd initWayPts = (bTraj.P) * initCoeff; // this returns a 50x3 matrix
-
-    std::vector<Eigen::Vector3d> initBernsteinTraj = convertMatTrajToVecTraj(initWayPts); // returns initial trajectory
+    rollouts.resize(numSampleTrajs + 1, ptsPerTraj);
 
     std::vector<Eigen::Vector3d> coeffs_ = bTraj.coeffs; // initial coefficients
 
-    path_to_weights2 = path_to_weights;
+    if (path_to_weights != path_to_weights2)
+    {
+        path_to_weights2 = path_to_weights;
 
-    assign_weights();
+        assign_weights();
+    }
 
-    double var = 5;
-    var_vector.x() = 7;
-    var_vector.y() = 7;
-    var_vector.z() = 7;
+    replan_count++;
 
-    int num_prev_top_traj = 0.2 * topSamples;
+    startTelemetry(sample_trajectory_pub, plan_dur_pub);
 
-    Eigen::MatrixXd prev_TopX(num_prev_top_traj, ptsPerTraj);
-    Eigen::MatrixXd prev_TopY(num_prev_top_traj, ptsPerTraj);
-    Eigen::MatrixXd prev_TopZ(num_prev_top_traj, ptsPerTraj);
+    // short time budgets, or what a late mode has left of one, go to the gradient backend alone
+    double remaining_ms = termination.remaining_ms();
+    bool use_cem = backend != LBFGS && remaining_ms > 0 && remaining_ms >= min_cem_budget_ms;
 
-    // steps -> randomly perturb -> generate path -> check for mmd cost -> select the best -> update mean and variance -> recompute the best one
-    for (int iter = 0; iter < numIterations; iter++)
+    if (use_mmd_lut || backend != CEM || !use_cem || screening.enabled)
     {
-        std::vector<std::vector<Eigen::Vector3d>> trajs;
-        std::vector<std::vector<Eigen::Vector3d>> trajsAcc;
-
-        std::cout << "Cross entropy Iteration " << iter << std::endl;
-
-        // perturb the coefficients now
+        build_mmd_table(*map);
+        screening.hinge_scale = mmd_table->lookup(0.0f);
+    }
 
-        // std::cout << coeffs_.size() <<  "*************************** "  << std::endl;
-        std::vector<Eigen::MatrixXd> perturbedCoeffs = bTraj.generatePerturbedCoeffs(numSampleTrajs, coeffs_, var_vector);
+    if (!worker_pool || (num_threads > 0 && worker_pool->size() != num_threads))
+    {
+        worker_pool = std::make_shared<Parallel::WorkerPool>(num_threads);
+        rollout_scratch.resize(worker_pool->size());
+    }
 
-        // std::cout<<"\n *************************************************************************************** \n"<< " done perturbing"  << std::endl;
+    double var = 5;
+    var_vector.x() = 7;
+    var_vector.y() = 7;
+    var_vector.z() = 7;
 
-        // generate the trajectories (xPts, yPts, zPts each of size -> numSampleTrajs x ptsPerTraj)
-        Eigen::MatrixXd xPts = ((bTraj.P) * (perturbedCoeffs.at(0).transpose())).transpose();
-        Eigen::MatrixXd yPts = ((bTraj.P) * (perturbedCoeffs.at(1).transpose())).transpose();
-        Eigen::MatrixXd zPts = ((bTraj.P) * (perturbedCoeffs.at(2).transpose())).transpose();
+    int num_prev_top_traj = 0.2 * topSamples;
 
-        // std::cout<<"\n *************************************************************************************** \n"<< " done perturbing 2"  << std::endl;
+    // elites of the previous plan shifted to this one, evaluated with the first samples
+    std::vector<Eigen::MatrixXd> prevTopCoeffs(3, Eigen::MatrixXd(num_prev_top_traj, coeffs_.size()));
 
-        /**
-         *   also compute stability costs -> by computing jerk and snaps
-         *   minimize the snap over time throughout the trajectory
-         *   smoothen the trajectory over time
-         *   re-allocate time if the jerk values are high
-         **/
+    bestCost = std::numeric_limits<double>::infinity();
 
-        Eigen::MatrixXd xAccPts = ((bTraj.Pddot) * (perturbedCoeffs.at(0).transpose())).transpose();
-        Eigen::MatrixXd yAccPts = ((bTraj.Pddot) * (perturbedCoeffs.at(1).transpose())).transpose();
-        Eigen::MatrixXd zAccPts = ((bTraj.Pddot) * (perturbedCoeffs.at(2).transpose())).transpose();
+    // elites of an earlier call stay in the archive while the map and the boundary conditions do
+    elite_archive.begin(map->version(), execTime, initCoeff);
 
-        // std::cout<<"\n *************************************************************************************** \n"<< " done perturbing 3"  << std::endl;
+    // seed mean, stddev and the first elites from the previous plan when its trajectory passes the new start
+    Eigen::MatrixXd warmMean;
+    std::vector<Eigen::MatrixXd> warmElites;
+    int num_seeded = 0;
 
-        std::vector<double> costTrajs(numSampleTrajs);
+    if (warm_start.seed(initCoeff, num_prev_top_traj, warmMean, warmElites))
+    {
+        coeffs_ = convertMatTrajToVecTraj(warmMean);
+        var_vector.setConstant(warm_start.stddev);
+        num_seeded = elite_archive.size() > 0 ? 0 : int(warmElites.size()); // the archived elites are already costed
 
-        for (int i = 0; i < numSampleTrajs; i++)
+        for (int axis = 0; axis < 3; axis++)
         {
-            std::vector<Eigen::Vector3d> traj;
-            std::vector<Eigen::Vector3d> trajAcc;
-            bool getCost = true;
-
-            for (int j = 0; j < ptsPerTraj; j++)
+            for (int p = 0; p < num_seeded; p++)
             {
-                Eigen::Vector3d pt(xPts(i, j), yPts(i, j), zPts(i, j));
-                Eigen::Vector3d ptAcc(xAccPts(i, j), yAccPts(i, j), zAccPts(i, j));
-
-                octomap::point3d octoPt(pt(0), pt(1), pt(2));
-
-                if (costMap3D.isInMap(octoPt))
-                {
-                    float dist_ = costMap3D.costMap->getDistance(octoPt);
+                prevTopCoeffs.at(axis).row(p) = warmElites.at(p).col(axis).transpose();
+            }
+        }
 
-                    if (dist_ < 0)
-                    {
-                        costTrajs.at(i) += infCost;
-                        getCost = false;
-                    }
-                }
+        std::cout << "Warm started from the previous plan with " << num_seeded << " elites" << std::endl;
+    }
 
-                if (!costMap3D.isInMap(octoPt))
-                {
-                    costTrajs.at(i) += infCost;
-                    getCost = false;
-                }
+    sample_schedule.start(numSampleTrajs, topSamples, num_prev_top_traj, var_vector);
 
-                traj.push_back(pt);
-                trajAcc.push_back(ptAcc);
-            }
+    if (covariance.enabled)
+    {
+        covariance.reset(int(coeffs_.size()), var_vector);
+    }
+    totalRollouts = 0;
+    cachedRollouts = 0;
+    screenedRollouts = 0;
+    screening.reset();
 
-            trajs.push_back(traj);
-            trajsAcc.push_back(trajAcc);
+    // steps -> randomly perturb -> generate path -> check for mmd cost -> select the best -> update mean and variance -> recompute the best one
+    for (int iter = 0; iter < (use_cem ? numIterations : 0); iter++)
+    {
+        std::cout << "Cross entropy Iteration " << iter << std::endl;
 
-            // now compute cost for each trajectory which is in the map and whose even 1 point does not collide with obstacles
-            if (getCost)
-            {
-                bool is_mean = false;
-                double cost = costPerTrajectory(traj, trajAcc, initBernsteinTraj, costMap3D, is_mean, plan_dur_pub);
-                costTrajs.at(i) = cost;
-            }
-        }
+        // perturb the coefficients now
 
-        std::vector<double> costTrajsorted = costTrajs;
-        std::sort(costTrajsorted.begin(), costTrajsorted.end());
+        // std::cout << coeffs_.size() <<  "*************************** "  << std::endl;
+        int num_samples = sample_schedule.samples();
+        int num_elites = sample_schedule.elites();
 
-        double valOptim = costTrajsorted.at(0);
-        auto itrOptim = std::find(costTrajs.begin(), costTrajs.end(), valOptim);
-        int indexOptim = itrOptim - costTrajs.begin();
+        std::vector<Eigen::MatrixXd> perturbedCoeffs;
 
-        for (int k = 0; k < 11; k++)
+        if (covariance.enabled)
         {
-            optimTrajCoeffs(k, 0) = perturbedCoeffs.at(0)(indexOptim, k); // coeffs_.at(k)(0);//perturbedCoeffs.at(0)(indexOptim,k);// // //
-            optimTrajCoeffs(k, 1) = perturbedCoeffs.at(1)(indexOptim, k); // coeffs_.at(k)(1);//perturbedCoeffs.at(1)(indexOptim,k);// // //;
-            optimTrajCoeffs(k, 2) = perturbedCoeffs.at(2)(indexOptim, k); // coeffs_.at(k)(2);//perturbedCoeffs.at(2)(indexOptim,k);// ///
+            covariance.sample(convertVecTrajToMatTraj(coeffs_), num_samples, replan_count, iter, perturbedCoeffs);
+        }
+        else
+        {
+            // seeded per (replan, iteration, mode) so that the modes draw different perturbations
+            unsigned int seed = RandomStreams::Stream(RandomStreams::CEM_COEFFS, replan_count, iter, 0xFFFFFFFFu, mode_index).block(0)[0] | 1u;
+            perturbedCoeffs = bTraj.generatePerturbedCoeffs(num_samples, coeffs_, var_vector, seed);
         }
 
-        // std::cout<<"\n"<<std::endl;
+        // the first rows are the archived elites (the warm started ones when there are none)
+        int num_reused = elite_archive.size() > 0 ? elite_archive.size() : num_seeded;
+        int num_cached = elite_archive.cache_costs ? elite_archive.size() : 0;
 
-        std::vector<Eigen::Vector3d> newCoeffs(11);
+        if (elite_archive.size() > 0)
+        {
+            elite_archive.restore_coefficients(perturbedCoeffs);
+        }
+        else
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                perturbedCoeffs.at(axis).topRows(num_reused) = prevTopCoeffs.at(axis).topRows(num_reused);
+            }
+        }
 
-        std::vector<int> topIndexes;
+        std::vector<double> costTrajs(num_samples);
 
-        if (iter > 0)
+        // generate the trajectories (positions and accelerations, num_samples x ptsPerTraj per axis),
+        // the cached elites bring their own along with their costs
+        if (num_cached > 0)
         {
+            std::vector<Eigen::MatrixXd> newCoeffs(3);
 
-            for (int index_top = 0; index_top < num_prev_top_traj; index_top++)
+            for (int axis = 0; axis < 3; axis++)
             {
-
-                xPts.row(index_top) = prev_TopX.row(index_top);
-                yPts.row(index_top) = prev_TopY.row(index_top);
-                zPts.row(index_top) = prev_TopZ.row(index_top);
+                newCoeffs.at(axis) = perturbedCoeffs.at(axis).bottomRows(num_samples - num_cached);
             }
-        }
 
-        for (int i = 0; i < topSamples; i++)
+            elite_archive.restore_rollouts(rollouts, costTrajs);
+            rollouts.evaluate(bTraj.P, bTraj.Pddot, newCoeffs, num_cached);
+        }
+        else
         {
-            auto it = costTrajsorted.begin();
-            double costVal = *it;
-            auto itr = std::find(costTrajs.begin(), costTrajs.end(), costVal);
-            int index = itr - costTrajs.begin();
-            topIndexes.push_back(index);
-
-            costTrajsorted.erase(costTrajsorted.begin());
+            rollouts.evaluate(bTraj.P, bTraj.Pddot, perturbedCoeffs);
         }
 
-        // add up the matrices which are in the topSamples
-        Eigen::MatrixXd sum_top_X = Eigen::MatrixXd::Zero(1, 11);
-        Eigen::MatrixXd sum_top_Y = Eigen::MatrixXd::Zero(1, 11);
-        Eigen::MatrixXd sum_top_Z = Eigen::MatrixXd::Zero(1, 11);
+        rollout_costs.evaluate(rollouts, num_cached, num_samples - num_cached);
 
-        Eigen::MatrixXd diffTopCoeffsX = Eigen::MatrixXd::Zero(1, 11);
-        Eigen::MatrixXd diffTopCoeffsY = Eigen::MatrixXd::Zero(1, 11);
-        Eigen::MatrixXd diffTopCoeffsZ = Eigen::MatrixXd::Zero(1, 11);
+        totalRollouts += num_samples - num_cached;
+        cachedRollouts += num_cached;
 
-        Eigen::MatrixXd xCoeff = perturbedCoeffs.at(0);
-        Eigen::MatrixXd yCoeff = perturbedCoeffs.at(1);
-        Eigen::MatrixXd zCoeff = perturbedCoeffs.at(2);
+        // every rollout only writes costTrajs.at(i) and draws from its own (iter, i) streams,
+        // so the costs do not depend on the number of workers
+        worker_pool->parallel_for(num_samples - num_cached, [&](int begin, int end, int worker)
+                                  {
+            RolloutScratch &scratch = rollout_scratch.at(worker);
 
-        Eigen::MatrixXd TopX(topSamples, ptsPerTraj);
-        Eigen::MatrixXd TopY(topSamples, ptsPerTraj);
-        Eigen::MatrixXd TopZ(topSamples, ptsPerTraj);
-
-        Eigen::MatrixXd TopX_mean(1, ptsPerTraj);
-        Eigen::MatrixXd TopY_mean(1, ptsPerTraj);
-        Eigen::MatrixXd TopZ_mean(1, ptsPerTraj);
-
-        int index = 0;
-
-        for (int p = 0; p < topSamples; p++)
-        {
-            TopX.row(p) = xPts.row(topIndexes.at(p)); // xPts dimension numsamples x pointspertraj
-            TopY.row(p) = yPts.row(topIndexes.at(p));
-            TopZ.row(p) = zPts.row(topIndexes.at(p));
-
-            if (p < num_prev_top_traj)
+            for (int i = num_cached + begin; i < num_cached + end; i++)
             {
+                costTrajs.at(i) = costPerTrajectory(i, *map, scratch, iter, i, false, screening.enabled ? screening.proxy_model() : rankingModel());
+            } });
 
-                prev_TopX.row(p) = TopX.row(p);
-                prev_TopY.row(p) = TopY.row(p);
-                prev_TopZ.row(p) = TopZ.row(p);
-            }
-        } // TopX and TopY and TOpZ dimension is topsamples x pointspertraj
+        if (screening.enabled)
+        {
+            screenRollouts(costTrajs, num_cached, num_samples, num_elites, iter, *map);
+        }
 
-        traj_vis.visulize_sampled_trajectories(TopX, TopY, TopZ, topSamples, ptsPerTraj, sample_trajectory_pub);
+        elites.select(costTrajs, num_elites);
 
-        std::vector<Eigen::Vector3d> mean_bernstein_trajectory;
+        int indexOptim = elites.indices.front();
 
-        for (int col = 0; col < ptsPerTraj; col++)
+        // keep the best rollout of all iterations, so that stopping early returns the best one found so far
+        if (costTrajs.at(indexOptim) < bestCost)
         {
-            Eigen::Vector3d waypoint_mean;
-            for (int row = 0; row < topSamples; row++)
-            {
+            bestCost = costTrajs.at(indexOptim);
 
-                TopX_mean(0, col) += TopX(row, col);
-                TopY_mean(0, col) += TopY(row, col);
-                TopZ_mean(0, col) += TopZ(row, col);
+            for (int k = 0; k < 11; k++)
+            {
+                optimTrajCoeffs(k, 0) = perturbedCoeffs.at(0)(indexOptim, k);
+                optimTrajCoeffs(k, 1) = perturbedCoeffs.at(1)(indexOptim, k);
+                optimTrajCoeffs(k, 2) = perturbedCoeffs.at(2)(indexOptim, k);
             }
-
-            TopX_mean /= topSamples;
-            TopY_mean /= topSamples;
-            TopZ_mean /= topSamples;
-
-            waypoint_mean(0) = TopX_mean(0, col);
-            waypoint_mean(1) = TopY_mean(0, col);
-            waypoint_mean(2) = TopZ_mean(0, col);
-
-            mean_bernstein_trajectory.push_back(waypoint_mean);
         }
 
-        /* ----------------------------------  */
+        // the carried over elites of the previous iteration are the first rows
+        int carried_elites = 0;
+        int num_carried = iter > 0 ? num_reused : 0;
 
-        Eigen::MatrixXd sumTopCoeffsX = Eigen::MatrixXd::Zero(1, 11);
-        Eigen::MatrixXd sumTopCoeffsY = Eigen::MatrixXd::Zero(1, 11);
-        Eigen::MatrixXd sumTopCoeffsZ = Eigen::MatrixXd::Zero(1, 11);
+        for (int p = 0; p < int(elites.indices.size()); p++)
+        {
+            if (elites.indices.at(p) < num_carried)
+                carried_elites++;
+        }
 
-        Eigen::MatrixXd Coeffx_top_Set = Eigen::MatrixXd::Zero(topSamples, 11);
-        Eigen::MatrixXd Coeffy_top_Set = Eigen::MatrixXd::Zero(topSamples, 11);
-        Eigen::MatrixXd Coeffz_top_Set = Eigen::MatrixXd::Zero(topSamples, 11);
+        Eigen::MatrixXd TopX(num_elites, ptsPerTraj);
+        Eigen::MatrixXd TopY(num_elites, ptsPerTraj);
+        Eigen::MatrixXd TopZ(num_elites, ptsPerTraj);
 
-        for (int i = 0; i < topSamples; i++)
+        for (int p = 0; p < num_elites; p++)
         {
-            // std::cout<<xCoeff.row(0)<<std::endl;
+            TopX.row(p) = rollouts.pos[0].row(elites.indices.at(p));
+            TopY.row(p) = rollouts.pos[1].row(elites.indices.at(p));
+            TopZ.row(p) = rollouts.pos[2].row(elites.indices.at(p));
+        } // TopX and TopY and TOpZ dimension is topsamples x pointspertraj
 
-            int index_ = topIndexes.at(i);
+        telemetry.trajectories(TopX, TopY, TopZ, num_elites);
 
-            sumTopCoeffsX += xCoeff.row(index_);
-            sumTopCoeffsY += yCoeff.row(index_);
-            sumTopCoeffsZ += zCoeff.row(index_);
-        }
+        /* ---------- fit the sampling distribution to the (weighted) elite coefficients ---------- */
 
-        /*
-        std::cout<<"#####################################################################################################"<<std::endl;
-        std::cout<<"At iteration "<<iter<<"Sums are "<<sumTopCoeffsX<<"\n"<<sumTopCoeffsY<<"\n"<<sumTopCoeffsZ<<std::endl;
-        std::cout<<"#####################################################################################################"<<std::endl;
-        */
-        // update the coefficient matrix to be used next time
-        for (int j = 0; j < 11; j++)
-        {
+        Eigen::MatrixXd meanCoeffs(coeffs_.size(), 3);
+        int numCoeffs = int(coeffs_.size());
 
-            newCoeffs.at(j)(0) = double(sumTopCoeffsX(0, j) / float(topSamples));
-            newCoeffs.at(j)(1) = double(sumTopCoeffsY(0, j) / float(topSamples));
-            newCoeffs.at(j)(2) = double(sumTopCoeffsZ(0, j) / float(topSamples));
-        }
+        for (int axis = 0; axis < 3; axis++)
+        {
+            Eigen::RowVectorXd mean, variance;
+            elites.fit(perturbedCoeffs.at(axis), mean, variance);
 
-        /* -------------------------*/
+            meanCoeffs.col(axis) = mean.transpose();
 
-        // now update the variance
+            // the first and last three coefficients are pinned to the boundary conditions and never sampled
+            if (covariance.enabled)
+            {
+                covariance.update(axis, perturbedCoeffs.at(axis), mean, elites, min_stddev);
+                var_vector(axis) = covariance.stddev(axis);
+            }
+            else
+            {
+                double free_variance = variance.segment(3, numCoeffs - 6).mean();
+                var_vector(axis) = std::max(min_stddev, std::sqrt(free_variance));
+            }
+        }
 
-        var_vector.x() = get_variance(TopX, iter); // this might be the bug the dimension is 20x50
-        var_vector.y() = get_variance(TopY, iter);
-        var_vector.z() = get_variance(TopZ, iter);
+        elite_archive.store(perturbedCoeffs, rollouts, costTrajs, elites.indices, num_prev_top_traj);
 
         std::cout << var_vector.x() << " " << var_vector.y() << "  " << var_vector.z() << "  "
-                  << "updated variance" << std::endl;
-
-        // variance <<  var_vector.x()  <<   " " << var_vector.y()  << "  " << var_vector.z()  << std::endl;
-
-        bTraj.generateTrajCoeffs(mean_bernstein_trajectory);
-        coeffs_.clear();
-        coeffs_ = bTraj.coeffs;
-        // bTraj.coeffs = newCoeffs ;
-        // coeffs_ = bTraj.coeffs;
+                  << "updated stddev" << std::endl;
 
-        std::vector<Eigen::Vector3d> mean_trajAcc;
+        sample_schedule.update(var_vector);
 
-        Eigen::Vector3d Pt_Acc;
+        coeffs_ = convertMatTrajToVecTraj(meanCoeffs);
+        bTraj.coeffs = coeffs_;
 
-        for (int i = 0; i < ptsPerTraj; i++)
+#if CCO_VOXEL_TELEMETRY
+        // the sampled distances of the mean trajectory only feed the distance stream
+        if (publish_telemetry && telemetry.running())
         {
+            std::vector<Eigen::MatrixXd> meanCoeffRows = {meanCoeffs.col(0).transpose(), meanCoeffs.col(1).transpose(), meanCoeffs.col(2).transpose()};
+            rollouts.evaluate(bTraj.P, bTraj.Pddot, meanCoeffRows, numSampleTrajs);
+            rollout_costs.evaluate(rollouts, numSampleTrajs, 1);
 
-            Eigen::Vector3d Pt_Acc(0, 0, 0);
-            mean_trajAcc.push_back(Pt_Acc);
+            // separator of the iterations in the distance stream
+            for (int j = 0; j < 30; j++)
+            {
+                telemetry.distance(1000.0);
+            }
+
+            // the mean trajectory gets the stream after the last sample trajectory
+            costPerTrajectory(numSampleTrajs, *map, rollout_scratch.at(0), iter, numSampleTrajs, true, SAMPLED_MMD);
         }
+#endif
 
-        // std::cout << coeffs_.size()  << "  " << coeffs_.at(0).rows() << "   " << coeffs_.at(0).cols()  << "  " << bestTraj_accx.rows() << " " << bestTraj_accx.cols()  <<  std::endl;
+        if (termination.update(iter, bestCost, var_vector, carried_elites, num_carried))
+        {
+            break;
+        }
+    }
 
-        std_msgs::Float64 dummy_data;
-        dummy_data.data = 1000.000;
+    if (use_cem)
+    {
+        std::cout << "Cross entropy stopped after " << termination.iterations() << " iterations (" << TerminationCriteria::to_string(termination.stop_reason())
+                  << ") in " << termination.elapsed_ms() << " ms with " << totalRollouts << " rollouts (" << cachedRollouts << " cached elites), best cost " << bestCost << std::endl;
 
-        for (int j = 0; j < 30; j++)
+        if (screening.enabled)
         {
+            std::cout << "Screening: " << totalRollouts - screenedRollouts << " of " << totalRollouts << " rollouts at full fidelity, proxy / full rank agreement: Spearman " << screening.spearman()
+                      << ", elite overlap " << screening.elite_overlap();
+
+            if (screening.audits() > 0)
+                std::cout << ", elite recall " << screening.elite_recall();
 
-            plan_dur_pub.publish(dummy_data);
+            std::cout << std::endl;
         }
+    }
+    else
+    {
+        // L-BFGS starts from the A* fit or the warm started mean
+        optimTrajCoeffs = convertVecTrajToMatTraj(coeffs_);
+    }
 
-        // ros::Duration(3).sleep();
-        bool is_mean = true;
-        double mean_traj_cost = costPerTrajectory(mean_bernstein_trajectory, mean_trajAcc, initBernsteinTraj, costMap3D, is_mean, plan_dur_pub);
-        // is_mean =false ;
-        // std::cout << " Iteration Complete change data file name " << std::endl;
+    if (backend != CEM || !use_cem)
+    {
+        polishTrajectory(bTraj, execTime, *map);
 
-        // ros::Duration(30).sleep();
-        double mean_smoothness = get_total_smoothness_cost(mean_bernstein_trajectory, execTime);
+        if (!use_cem)
+        {
+            coeffs_ = convertMatTrajToVecTraj(optimTrajCoeffs);
+        }
     }
 
     Eigen::MatrixXd bestTraj = ((bTraj.P) * optimTrajCoeffs);
@@ -442,280 +508,493 @@ std::vector<Eigen::Vector3d> Optimizer::CrossEntropyOptimizer::optimizeTrajector
         // std::cout<<pt(0)<<"\t"<<pt(1)<<"\t"<<pt(2)<<std::endl;
     }
 
-    double smoothness_cost = get_total_smoothness_cost(optimTraj, execTime);
+    // the returned trajectory, the final mean and the last elites seed the next replan
+    std::vector<Eigen::MatrixXd> finalElites(1, optimTrajCoeffs);
+
+    for (int p = 0; p < elite_archive.size(); p++)
+    {
+        finalElites.push_back(elite_archive.coefficients(p));
+    }
 
-    // std::cout << smoothness_cost << "smoothness_cost" <<std::endl;
+    warm_start.store(convertVecTrajToMatTraj(coeffs_), finalElites, bestTraj.transpose());
 
     return optimTraj;
 }
 
-double Optimizer::CrossEntropyOptimizer::get_variance(Eigen::MatrixXd one_dimension_trajectory, int iter)
+/************************************************************************************
+ * Multi-modal optimization
+ * Every mode is a single-mode optimizer with the settings of this one, seeded from its own
+ * lateral offset of the A* path; the modes run in parallel on the worker pool (one mode per
+ * worker when num_threads >= num_modes, rollouts of a mode on its own thread) and the mode
+ * with the cheapest best rollout wins. All modes draw the same collision noise, so their costs
+ * are compared on common random numbers. The time budget covers the whole call: with more modes
+ * than workers the modes run in waves, and a later mode only gets what is left of the budget.
+ ************************************************************************************/
+std::vector<Eigen::Vector3d> Optimizer::CrossEntropyOptimizer::optimizeModes(const Bernstein::BernsteinPath &bTraj, const std::vector<Eigen::Vector3d> &wayPts, float execTime, const Map3D::MapSnapshotPtr &map,
+                                                                             ros::Publisher sample_trajectory_pub, ros::Publisher plan_dur_pub, const std::string &path_to_weights)
 {
-
-    int coeff_size = 11;
-    double variance_value = 0;
-    Eigen::MatrixXd mean(1, 11);
-    Eigen::MatrixXd mean_sum(1, 1);
-    mean_sum.setZero();
-    // std::cout << "here " << one_dimension_trajectory.rows() <<  " "  << one_dimension_trajectory.cols()  << std::endl;
-    int total_size = one_dimension_trajectory.rows() * one_dimension_trajectory.cols();
-
-    for (int k = 0; k < one_dimension_trajectory.cols(); k++)
+    if (!worker_pool || (num_threads > 0 && worker_pool->size() != num_threads))
     {
-        for (int l = 0; l < one_dimension_trajectory.rows(); l++)
-        {
-            mean_sum(0, 0) += one_dimension_trajectory(l, k) / (total_size);
-        }
+        worker_pool = std::make_shared<Parallel::WorkerPool>(num_threads);
+        rollout_scratch.resize(worker_pool->size());
     }
 
-    for (int i = 0; i < one_dimension_trajectory.rows(); i++)
+    while (int(modes.size()) < num_modes)
     {
-        for (int j = 0; j < 11; j++)
-        {
-            variance_value += pow((one_dimension_trajectory(i, j) - mean_sum(0, 0)), 2);
-            // std::cout << variance_value << std::endl;
-        }
+        modes.emplace_back(new CrossEntropyOptimizer(numIterations));
+        modes.back()->mode_index = uint32_t(modes.size() - 1);
     }
 
-    variance_value = variance_value / (total_size);
+    std::vector<std::vector<Eigen::Vector3d>> seeds = lateral_seeds(wayPts, num_modes, mode_offset);
+    std::vector<std::vector<Eigen::Vector3d>> results(num_modes);
 
-    // std::cout << variance_value << std::endl;
-    return variance_value;
-}
+    termination.start();
 
-double Optimizer::CrossEntropyOptimizer::get_acc_cost(Eigen::Vector3d acc_in)
-{
+    for (int m = 0; m < num_modes; m++)
+    {
+        modes[m]->copySettings(*this);
+        modes[m]->shares_budget = true;
+        modes[m]->budget_start = termination.started_at();
+    }
 
-    double acc_val = acc_in.norm();
-    double amin = -1.0;
-    double amax = 1.5;
+    startTelemetry(sample_trajectory_pub, plan_dur_pub);
 
-    double acc_cost = 0;
+    worker_pool->parallel_for(num_modes, [&](int begin, int end, int worker)
+                              {
+        for (int m = begin; m < end; m++)
+        {
+            results[m] = modes[m]->optimizeTrajectory(bTraj, seeds[m], execTime, map, sample_trajectory_pub, plan_dur_pub, path_to_weights);
+        } });
 
-    if (acc_val > amax || acc_val < amin)
+    if (termination.time_budget_ms > 0 && termination.remaining_ms() < 0)
     {
-
-        acc_cost = (acc_val - amin) * (acc_val - amax);
+        std::cout << "Modes exceeded the time budget by " << -termination.remaining_ms() << " ms (" << num_modes << " modes on " << worker_pool->size() << " workers)" << std::endl;
     }
-    else
+
+    winning_mode = 0;
+    totalRollouts = 0;
+    cachedRollouts = 0;
+    screenedRollouts = 0;
+
+    for (int m = 0; m < num_modes; m++)
     {
-        acc_cost = 0;
+        std::cout << "Mode " << m << " best cost " << modes[m]->bestCost << " (" << TerminationCriteria::to_string(modes[m]->termination.stop_reason()) << ")" << std::endl;
+
+        totalRollouts += modes[m]->totalRollouts;
+        cachedRollouts += modes[m]->cachedRollouts;
+        screenedRollouts += modes[m]->screenedRollouts;
+
+        if (modes[m]->bestCost < modes[winning_mode]->bestCost)
+            winning_mode = m;
     }
 
-    return acc_cost;
-}
+    // the trajectory of every mode
+    Eigen::MatrixXd modeX(num_modes, ptsPerTraj), modeY(num_modes, ptsPerTraj), modeZ(num_modes, ptsPerTraj);
 
-double Optimizer::CrossEntropyOptimizer::get_elastic_band_cost(std::vector<Eigen::Vector3d> traj_in)
-{
-    double elastic_cost = 0;
-    for (int i = 1; i < traj_in.size() - 1; i++)
+    for (int m = 0; m < num_modes; m++)
     {
-        Eigen::Vector3d pt_before = traj_in.at(i - 1);
-        Eigen::Vector3d pt_current = traj_in.at(i);
-        Eigen::Vector3d pt_next = traj_in.at(i + 1);
+        for (int j = 0; j < ptsPerTraj; j++)
+        {
+            modeX(m, j) = results[m].at(j)(0);
+            modeY(m, j) = results[m].at(j)(1);
+            modeZ(m, j) = results[m].at(j)(2);
+        }
+    }
+
+    telemetry.trajectories(modeX, modeY, modeZ, num_modes);
+
+    const CrossEntropyOptimizer &winner = *modes[winning_mode];
 
-        Eigen::Vector3d diff;
+    bestCost = winner.bestCost;
+    optimTrajCoeffs = winner.optimTrajCoeffs;
+    var_vector = winner.var_vector;
 
-        diff = pt_before - 2 * pt_current + pt_next;
-        elastic_cost += diff.norm();
+    if (bestCost >= infCost)
+    {
+        std::cout << "No collision free mode out of " << num_modes << std::endl;
     }
 
-    return elastic_cost;
+    std::cout << "Mode " << winning_mode << " wins after " << termination.elapsed_ms() << " ms with " << totalRollouts << " rollouts" << std::endl;
+
+    return results[winning_mode];
 }
 
 /************************************************************************************
- * Get overall costs for each trajectory
- * Overall cost includes collision cost using MMD,stability cost and smoothness cost
+ * Second stage of the multi-fidelity costing
+ * Rows [first, num_samples) hold proxy costs; the cheapest of them (the contenders) are
+ * costed again with the sampled MMD, the rest are moved behind every contender. Rollouts
+ * that left the map or hit an obstacle exit at the same waypoint under every model, so
+ * their proxy cost already is the full one.
  ************************************************************************************/
-double Optimizer::CrossEntropyOptimizer::costPerTrajectory(std::vector<Eigen::Vector3d> traj, std::vector<Eigen::Vector3d> trajAcc, std::vector<Eigen::Vector3d> initBernsteinTraj, Map3D::OctoMapEDT costMap3D, bool is_mean,
-                                                           ros::Publisher plan_dur_pub)
+void Optimizer::CrossEntropyOptimizer::screenRollouts(std::vector<double> &costTrajs, int first, int num_samples, int num_elites, int iteration, const Map3D::MapSnapshot &map)
 {
+    int num_contenders = screening.contenders(num_samples - first, num_elites);
+    int num_full = screening.audit ? num_samples - first : num_contenders;
 
-    double cost = 0.0;
-    double collisionCost = 0.0;
-    double stabilityCost = 0.0;
-    double smoothnessCost = 0.0;
-    double elastic_band_cost = 0;
-    int number_of_points_in_distribution = 100;
+    proxyCosts = costTrajs;
+    const std::vector<int> &order = screening.rank(proxyCosts, first, num_samples);
 
-    elastic_band_cost = get_elastic_band_cost(traj);
+    worker_pool->parallel_for(num_full, [&](int begin, int end, int worker)
+                              {
+        RolloutScratch &scratch = rollout_scratch.at(worker);
 
-    // std::ofstream dist_measurments("dist_measurments.csv");
+        for (int k = begin; k < end; k++)
+        {
+            int i = order[k];
 
-    // Eigen::MatrixXd total_dist_per_iteration(traj.size()*number_of_points_in_distribution  ,1 );
+            if (proxyCosts[i] < infCost)
+                costTrajs.at(i) = costPerTrajectory(i, map, scratch, iteration, i, false, SAMPLED_MMD);
+        } });
 
-    // std::cout << is_mean <<std::endl;
+    screening.record(proxyCosts, costTrajs, num_contenders, num_elites);
 
-    for (int i = 0; i < traj.size(); i++)
+    if (screening.audit)
     {
+        screening.record_audit(costTrajs, num_contenders, num_elites);
+    }
 
-        Eigen::Vector3d pt = traj.at(i);
-        Eigen::Vector3d ptAcc = trajAcc.at(i);
-        Eigen::Vector3d ptInit = initBernsteinTraj.at(i);
+    // behind the contenders and every infeasible rollout (at most 2 infCost), in proxy order
+    for (int k = num_contenders; k < int(order.size()); k++)
+    {
+        costTrajs.at(order[k]) = 2.0 * infCost + proxyCosts[order[k]];
+    }
 
-        stabilityCost += get_acc_cost(ptAcc); // ptAcc.norm();
-        smoothnessCost += (pt - ptInit).norm();
+    screenedRollouts += int(order.size()) - num_contenders;
+}
 
-        /** collision cost calculation **/
-        octomap::point3d p(pt(0), pt(1), pt(2));
-        float dist = costMap3D.costMap->getDistance(p);
-        if (dist < 2.0)
-        {
-            // generate random distribution around this value
+/************************************************************************************
+ * Gradient backend
+ * L-BFGS on the trilinear cost field from optimTrajCoeffs; the result replaces it only
+ * when its rollout cost (costPerTrajectory, the cost the CEM ranks by) is lower, so that
+ * the surrogate field can never make the returned trajectory worse
+ ************************************************************************************/
+void Optimizer::CrossEntropyOptimizer::polishTrajectory(const Bernstein::BernsteinPath &bTraj, float execTime, const Map3D::MapSnapshot &map)
+{
+    auto rolloutCost = [&](const Eigen::MatrixXd &coeffs)
+    {
+        std::vector<Eigen::MatrixXd> coeffRows = {coeffs.col(0).transpose(), coeffs.col(1).transpose(), coeffs.col(2).transpose()};
+        rollouts.evaluate(bTraj.P, bTraj.Pddot, coeffRows, numSampleTrajs);
+        rollout_costs.evaluate(rollouts, numSampleTrajs, 1);
 
-            std::default_random_engine de(time(0));
-            std::normal_distribution<double> edtDist(dist, 1.0);
+        // the stream after the last CEM iteration
+        return costPerTrajectory(numSampleTrajs, map, rollout_scratch.at(0), numIterations, numSampleTrajs, false, rankingModel());
+    };
 
-            std::vector<double> actualDistibution, idealDistribution, weights;
-            Eigen::MatrixXf actual_distribution(1, number_of_points_in_distribution);
+    if (!std::isfinite(bestCost))
+    {
+        bestCost = rolloutCost(optimTrajCoeffs);
+    }
 
-            for (int r = 0; r < number_of_points_in_distribution; r++)
-            {
-                actual_distribution(0, r) = (std::max(0.0, (safeRadius - edtDist(de))));
-                if (is_mean == true)
-                {
-                    std_msgs::Float64 distance;
-                    distance.data = float(actual_distribution(0, r));
-                    // ros::Duration(0.1).sleep();
+    // tabulated MMD of the EDT distance, trilinear, filled by every mode that polishes on this map
+    std::shared_ptr<const MMDFunctions::MMD_lookup_table> table = mmd_table;
+    std::shared_ptr<const Map3D::CostField> cost_field = map.derived<Map3D::CostField>(mmd_table_key() + " field " + std::to_string(gradient.field_resolution), [&]()
+                                                                                       {
+        std::shared_ptr<Map3D::CostField> field = std::make_shared<Map3D::CostField>();
+        field->reset(map, gradient.field_resolution, [table](float dist)
+                     { return dist < 2.0f ? table->lookup(dist) : 0.0f; });
+        return field; });
 
-                    plan_dur_pub.publish(distance);
-                    // std::cout << "mean distance publish" << std::endl;
-                }
-            }
+    gradient.amin = rollout_costs.amin;
+    gradient.amax = rollout_costs.amax;
 
-            // collisionCost += mmdPerPoint(actualDistibution, idealDistribution, weights, 50);
+    Eigen::MatrixXd coeffs = optimTrajCoeffs;
+    double objective = gradient.optimize(bTraj.P, bTraj.Pddot, execTime, *cost_field, coeffs);
+    double cost = rolloutCost(coeffs);
 
-            // collisionCost += mmdPerPoint_interpolation( dist);
+    std::cout << "L-BFGS objective " << gradient.initial_objective() << " -> " << objective << " in " << gradient.iterations() << " iterations (" << gradient.evaluations() << " evaluations, "
+              << cost_field->filled() << " field nodes), rollout cost " << bestCost << " -> " << cost << (cost < bestCost ? "" : " rejected") << std::endl;
 
-            collisionCost += mmdPerPoint_transforms(actual_distribution); // MMD_transformed_features_RBF
-        }
-        else
-        {
-            collisionCost += 0;
+    if (cost < bestCost)
+    {
+        bestCost = cost;
+        optimTrajCoeffs = coeffs;
+    }
+}
 
-            if (is_mean == true)
+/************************************************************************************
+ * Background publishing of the telemetry, started on the first call
+ ************************************************************************************/
+void Optimizer::CrossEntropyOptimizer::startTelemetry(ros::Publisher sample_trajectory_pub, ros::Publisher plan_dur_pub)
+{
+    if (publish_telemetry && !telemetry.running())
+    {
+        telemetry.start(
+            telemetry_rate,
+            [plan_dur_pub](const std::vector<float> &values)
             {
-                std_msgs::Float64 temp_distance;
-
-                temp_distance.data = 0;
+                // one message per drain, the distances in the order they were recorded
+                std_msgs::Float64MultiArray distances;
+                distances.data.assign(values.begin(), values.end());
+
+                plan_dur_pub.publish(distances);
+            },
+            [sample_trajectory_pub](const Eigen::MatrixXd &X, const Eigen::MatrixXd &Y, const Eigen::MatrixXd &Z)
+            { traj_vis.visulize_sampled_trajectories(X, Y, Z, int(X.rows()), int(X.cols()), sample_trajectory_pub); });
+    }
+}
 
-                plan_dur_pub.publish(temp_distance);
+/************************************************************************************
+ * Forget the last plan in this optimizer and in every mode, copySettings leaves the
+ * warm start history of a mode alone
+ ************************************************************************************/
+void Optimizer::CrossEntropyOptimizer::resetWarmStart()
+{
+    warm_start.reset();
 
-                // std::cout <<  "outside" << std::endl;
-            }
-        }
+    for (auto &mode : modes)
+    {
+        mode->resetWarmStart();
     }
+}
 
-    // dist_measurments.close();
-
-    // std::cout<<"Cost values are: {collision, stability, smoothness} "<<collisionCost<<"\t"<<stabilityCost<<"\t"<<smoothnessCost<<std::endl;
-    cost = collisionCost + 0.50 * stabilityCost + 0.001 * elastic_band_cost;
-    return cost;
+/************************************************************************************
+ * Settings of other, the state (samples, elites, warm start history) stays
+ ************************************************************************************/
+void Optimizer::CrossEntropyOptimizer::copySettings(const CrossEntropyOptimizer &other)
+{
+    numIterations = other.numIterations;
+    topSamples = other.topSamples;
+    safeRadius = other.safeRadius;
+    ptsPerTraj = other.ptsPerTraj;
+    numSampleTrajs = other.numSampleTrajs;
+    infCost = other.infCost;
+    number_of_points_in_distribution = other.number_of_points_in_distribution;
+
+    elites.weighting = other.elites.weighting;
+    elites.temperature = other.elites.temperature;
+    min_stddev = other.min_stddev;
+
+    elite_archive.cache_costs = other.elite_archive.cache_costs;
+
+    covariance.enabled = other.covariance.enabled;
+    covariance.bandwidth = other.covariance.bandwidth;
+    covariance.stream_id = mode_index;
+
+    termination = other.termination;
+
+    warm_start.enabled = other.warm_start.enabled;
+    warm_start.blend = other.warm_start.blend;
+    warm_start.stddev = other.warm_start.stddev;
+    warm_start.max_offset = other.warm_start.max_offset;
+
+    sample_schedule.enabled = other.sample_schedule.enabled;
+    sample_schedule.min_samples = other.sample_schedule.min_samples;
+    sample_schedule.min_elites = other.sample_schedule.min_elites;
+
+    use_mmd_lut = other.use_mmd_lut;
+    mmd_table_draws = other.mmd_table_draws;
+
+    screening.enabled = other.screening.enabled;
+    screening.fraction = other.screening.fraction;
+    screening.proxy = other.screening.proxy;
+    screening.audit = other.screening.audit;
+    mmd_kernel = other.mmd_kernel;
+    noise_sampling = other.noise_sampling;
+
+    backend = other.backend;
+    min_cem_budget_ms = other.min_cem_budget_ms;
+    gradient = other.gradient;
+
+    // the rollouts of a mode run on the worker of the mode
+    num_threads = 1;
+    num_modes = 1;
+    publish_telemetry = false;
 }
 
-float Optimizer::CrossEntropyOptimizer::mmdPerPoint_transforms(Eigen::MatrixXf actual_distribution)
+double Optimizer::CrossEntropyOptimizer::get_variance(Eigen::MatrixXd one_dimension_trajectory, int iter)
 {
 
-    Eigen::MatrixXf transformed_features(1, 5);
+    int coeff_size = 11;
+    double variance_value = 0;
+    Eigen::MatrixXd mean(1, 11);
+    Eigen::MatrixXd mean_sum(1, 1);
+    mean_sum.setZero();
+    // std::cout << "here " << one_dimension_trajectory.rows() <<  " "  << one_dimension_trajectory.cols()  << std::endl;
+    int total_size = one_dimension_trajectory.rows() * one_dimension_trajectory.cols();
 
-    transformed_features = actual_distribution * Weights;
+    for (int k = 0; k < one_dimension_trajectory.cols(); k++)
+    {
+        for (int l = 0; l < one_dimension_trajectory.rows(); l++)
+        {
+            mean_sum(0, 0) += one_dimension_trajectory(l, k) / (total_size);
+        }
+    }
 
-    // std::cout << transformed_features << std::endl;
+    for (int i = 0; i < one_dimension_trajectory.rows(); i++)
+    {
+        for (int j = 0; j < 11; j++)
+        {
+            variance_value += pow((one_dimension_trajectory(i, j) - mean_sum(0, 0)), 2);
+            // std::cout << variance_value << std::endl;
+        }
+    }
 
-    int num_samples_of_distance_distribution = transformed_features.cols();
-    Eigen::MatrixXf squared_dist(1, num_samples_of_distance_distribution);
-    Eigen::MatrixXf temp(1, num_samples_of_distance_distribution);
-    Eigen::MatrixXf alpha_weights(1, num_samples_of_distance_distribution);
+    variance_value = variance_value / (total_size);
 
-    alpha_weights.setOnes();
+    // std::cout << variance_value << std::endl;
+    return variance_value;
+}
 
-    // temp = actual_distribution.array();
+/************************************************************************************
+ * Get overall cost of a rollout in one pass over its waypoints
+ * Every waypoint queries the EDT once; the query decides feasibility and feeds the
+ * collision cost (mmd_table, or a sampled distance distribution per waypoint closer than
+ * 2 m that is evaluated in one batched MMD call at the end); the stability and elastic band
+ * terms come from rollout_costs, evaluated for the whole block of rollouts beforehand.
+ * A sample rollout stops at its first waypoint i outside the map or inside an obstacle; its
+ * cost infCost * (2 - i / ptsPerTraj) still ranks infeasible rollouts by how far they get.
+ * The mean trajectory (telemetry only) is always costed in full, as is its distance telemetry.
+ * Every waypoint draws from its own (iteration, sample, point) stream of this replan.
+ ************************************************************************************/
+double Optimizer::CrossEntropyOptimizer::costPerTrajectory(int rollout, const Map3D::MapSnapshot &map, RolloutScratch &scratch, int iteration, int sample, bool is_mean, CollisionModel model)
+{
+    int num_points = rollouts.points();
+    bool tabulated = model != SAMPLED_MMD && !is_mean;
 
-    squared_dist = (transformed_features.array()).square();
+    double collisionCost = 0.0;
+    int num_rows = 0;
 
-    Eigen::MatrixXf kernel_matrix1(num_samples_of_distance_distribution, num_samples_of_distance_distribution);
-    Eigen::MatrixXf temp_kernel_matrix1(num_samples_of_distance_distribution, num_samples_of_distance_distribution);
-    Eigen::MatrixXf temp_kernel_matrix2(num_samples_of_distance_distribution, num_samples_of_distance_distribution);
+    if (!tabulated)
+    {
+        scratch.distributions.resize(num_points, number_of_points_in_distribution);
+    }
 
-    Eigen::MatrixXf One_matrix(num_samples_of_distance_distribution, num_samples_of_distance_distribution);
-    One_matrix.setOnes();
+    for (int i = 0; i < num_points; i++)
+    {
+        octomap::point3d p(rollouts.pos[0](rollout, i), rollouts.pos[1](rollout, i), rollouts.pos[2](rollout, i));
+        if (!is_mean && !map.isInMap(p))
+        {
+            return infCost * (2.0 - double(i) / num_points);
+        }
 
-    // std::cout << " Entered the main funciton /////////////" << std::endl;
-    temp_kernel_matrix1 = transformed_features.transpose() * transformed_features;
+        float dist = map.distance(p);
 
-    temp_kernel_matrix2 = squared_dist.transpose() * squared_dist;
+        if (!is_mean && dist < 0)
+        {
+            return infCost * (2.0 - double(i) / num_points);
+        }
 
-    kernel_matrix1 = One_matrix + 2 * temp_kernel_matrix1 + temp_kernel_matrix2;
+        /** collision cost calculation **/
+        if (dist < 2.0 && tabulated)
+        {
+            collisionCost += model == EDT_HINGE ? screening.hinge_scale * 0.25 * (2.0 - dist) * (2.0 - dist) : mmd_table->lookup(dist);
+        }
+        else if (dist < 2.0)
+        {
+            // generate random distribution around this value
+            Eigen::RowVectorXf &edtDist = scratch.edtDist;
 
-    Eigen::Matrix<float, 1, 1> res;
-    Eigen::Matrix<float, 1, 1> res1;
-    Eigen::Matrix<float, 1, 1> res2;
-    Eigen::Matrix<float, 1, 1> res3;
+            edtDist.resize(number_of_points_in_distribution);
+            RandomStreams::fill_noise(noise_sampling, RandomStreams::Stream(RandomStreams::CEM_COLLISION, replan_count, iteration, sample, i), edtDist.data(), number_of_points_in_distribution, dist, 1.0);
 
-    float temp_value = 0;
+            scratch.distributions.row(num_rows) = (float(safeRadius) - edtDist.array()).max(0.0f);
 
-    double res_val;
-    res1 = alpha_weights * kernel_matrix1 * (alpha_weights.transpose());
+            if (is_mean == true)
+            {
+                for (int r = 0; r < number_of_points_in_distribution; r++)
+                {
+                    telemetry.distance(scratch.distributions(num_rows, r));
+                }
+            }
 
-    res2(0, 0) = num_samples_of_distance_distribution;
-    res3(0, 0) = num_samples_of_distance_distribution;
+            num_rows++;
+        }
+        else if (is_mean == true)
+        {
+            telemetry.distance(0);
+        }
+    }
 
-    res(0, 0) = res1(0, 0) - 2 * res2(0, 0) + res3(0, 0);
-    res_val = double(res(0, 0));
+    if (!tabulated)
+    {
+        // one batched MMD evaluation for the near-obstacle waypoints of the rollout, summed in waypoint order
+        collisionCost = MMDFunctions::transformed_MMD_batch(scratch.distributions.topRows(num_rows), Weights, scratch.mmd, mmd_kernel);
+    }
 
-    return float(res_val);
+    return collisionCost + 0.50 * rollout_costs.stability(rollout) + 0.001 * rollout_costs.elastic_band(rollout);
 }
 
-void Optimizer::CrossEntropyOptimizer::assign_weights()
+/************************************************************************************
+ * Tabulate the collision MMD over [0, 2] m
+ * The sampled distribution of a waypoint is max(0, safeRadius - dist - z) with z ~ N(0, 1),
+ * a fresh draw of z per waypoint, so every entry is the MMD averaged over mmd_table_draws
+ * draws of z (the same draws for every distance, which keeps the table smooth). The table
+ * is checked against one independent draw per probe, the cost the sampled model would give.
+ * The draws are those of the map version, so the table is built once per map snapshot and
+ * shared by every mode and replan that costs on it with the same settings.
+ ************************************************************************************/
+std::string Optimizer::CrossEntropyOptimizer::mmd_table_key() const
 {
+    return "cem mmd table " + path_to_weights2 + " kernel " + std::to_string(int(mmd_kernel)) + " sampling " + std::to_string(int(noise_sampling)) + " draws " + std::to_string(mmd_table_draws) +
+           " points " + std::to_string(number_of_points_in_distribution) + " radius " + std::to_string(safeRadius);
+}
 
-    int rows = 100;
-    int cols = 5;
-    // std::cout << path_to_weights2 <<" " << " ------------------ " << std::endl;
+void Optimizer::CrossEntropyOptimizer::build_mmd_table(const Map3D::MapSnapshot &map)
+{
+    mmd_table = map.derived<MMDFunctions::MMD_lookup_table>(mmd_table_key(), [&]()
+                                                             {
+        std::shared_ptr<MMDFunctions::MMD_lookup_table> table = std::make_shared<MMDFunctions::MMD_lookup_table>();
+        uint32_t epoch = uint32_t(map.version());
 
-    std::string file = path_to_weights2;
-    std::ifstream in(file);
+        int num_draws = std::max(1, mmd_table_draws);
+        int n = number_of_points_in_distribution;
 
-    std::string line;
+        Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> noise(num_draws, n);
 
-    int row = 0;
-    int col = 0;
+        for (int k = 0; k < num_draws; k++)
+        {
+            RandomStreams::fill_noise(noise_sampling, RandomStreams::Stream(RandomStreams::CEM_TABLE, epoch, k), noise.row(k).data(), n, 0.0, 1.0);
+        }
 
-    Eigen::MatrixXf res = Eigen::MatrixXf(rows, cols);
+        noise = float(safeRadius) - noise.array();
 
-    if (in.is_open())
-    {
+        Eigen::MatrixXf distributions;
+        Eigen::VectorXf draw_values;
 
-        while (std::getline(in, line))
+        auto expected_mmd = [&](const Eigen::VectorXf &distances, Eigen::VectorXf &mmd_values)
         {
+            // row d * num_draws + k holds draw k at distance d
+            distributions.resize(distances.size() * num_draws, n);
 
-            char *ptr = (char *)line.c_str();
-            int len = line.length();
+            for (int d = 0; d < distances.size(); d++)
+            {
+                distributions.middleRows(d * num_draws, num_draws) = (noise.array() - distances(d)).max(0.0f).matrix();
+            }
 
-            col = 0;
+            MMDFunctions::transformed_MMD_batch(distributions, Weights, draw_values, mmd_kernel);
 
-            char *start = ptr;
-            for (int i = 0; i < len; i++)
-            {
+            mmd_values = Eigen::Map<const Eigen::MatrixXf>(draw_values.data(), num_draws, distances.size()).colwise().mean().transpose();
+        };
 
-                if (ptr[i] == ',')
-                {
-                    res(row, col++) = atof(start);
-                    start = ptr + i + 1;
-                }
+        auto sampled_mmd = [&](const Eigen::VectorXf &distances, Eigen::VectorXf &mmd_values)
+        {
+            Eigen::RowVectorXf edtDist(n);
+            distributions.resize(distances.size(), n);
+
+            for (int d = 0; d < distances.size(); d++)
+            {
+                RandomStreams::fill_noise(noise_sampling, RandomStreams::Stream(RandomStreams::CEM_TABLE, epoch, num_draws, d), edtDist.data(), n, distances(d), 1.0);
+                distributions.row(d) = (float(safeRadius) - edtDist.array()).max(0.0f);
             }
-            res(row, col) = atof(start);
 
-            row++;
-        }
+            MMDFunctions::transformed_MMD_batch(distributions, Weights, mmd_values, mmd_kernel);
+        };
 
-        in.close();
-    }
+        table->build(expected_mmd, 0.0, 2.0, 201, MMDFunctions::MMD_lookup_table::CUBIC, sampled_mmd);
+
+        return table; });
+}
+
+float Optimizer::CrossEntropyOptimizer::mmdPerPoint_transforms(const Eigen::MatrixXf &actual_distribution)
+{
+
+    return MMDFunctions::transformed_MMD(actual_distribution, Weights);
+}
 
-    Weights = res;
+void Optimizer::CrossEntropyOptimizer::assign_weights()
+{
 
-    std::cout << Weights.rows() << " " << Weights.cols() << "  "
-              << "Weights assigned" << std::endl;
+    MMDFunctions::load_weights(path_to_weights2, Weights);
 }
 
 double Optimizer::CrossEntropyOptimizer::mmdPerPoint_interpolation(float distance)
@@ -743,56 +1022,11 @@ double Optimizer::CrossEntropyOptimizer::mmdPerPoint_interpolation(float distanc
     return double(result(0, 0));
 }
 
-float Optimizer::CrossEntropyOptimizer::RBF_kernel(float val1, float val2)
-{
-
-    float data1 = std::pow((val1 - val2), 2) / (-2 * std::pow(0.1, 2));
-    float data2 = std::exp(data1);
 
-    return data2;
-}
-
-float Optimizer::CrossEntropyOptimizer::MMD_transformed_features_RBF(Eigen::MatrixXf actual_distribution)
+float Optimizer::CrossEntropyOptimizer::MMD_transformed_features_RBF(const Eigen::MatrixXf &actual_distribution)
 {
 
-    Eigen::MatrixXf transformed_features(1, 5);
-
-    transformed_features = actual_distribution * Weights;
-
-    // std::cout << transformed_features << std::endl;
-
-    int num_samples_of_distance_distribution = transformed_features.cols();
-
-    Eigen::MatrixXf Matrix1(num_samples_of_distance_distribution, num_samples_of_distance_distribution);
-    Eigen::MatrixXf Matrix2(num_samples_of_distance_distribution, num_samples_of_distance_distribution);
-    Eigen::MatrixXf Matrix3(num_samples_of_distance_distribution, num_samples_of_distance_distribution);
-
-    for (int i = 0; i < num_samples_of_distance_distribution; i++)
-    {
-
-        for (int j = 0; j < num_samples_of_distance_distribution; j++)
-        {
-
-            Matrix1(i, j) = RBF_kernel(transformed_features(0, i), transformed_features(0, j));
-            Matrix2(i, j) = RBF_kernel(transformed_features(0, i), 0.0);
-            Matrix3(i, j) = RBF_kernel(0.0, 0.0);
-        }
-    }
-
-    Eigen::MatrixXf alpha_weights(1, num_samples_of_distance_distribution);
-    alpha_weights.setOnes();
-
-    Eigen::Matrix<float, 1, 1> cost1;
-    Eigen::Matrix<float, 1, 1> cost2;
-    Eigen::Matrix<float, 1, 1> cost3;
-
-    cost1 = alpha_weights * Matrix1 * alpha_weights.transpose();
-    cost2 = alpha_weights * Matrix2 * alpha_weights.transpose();
-    cost3 = alpha_weights * Matrix3 * alpha_weights.transpose();
-
-    float MMD_RBF_cost = cost1(0, 0) - 2 * cost2(0, 0) + cost3(0, 0);
-
-    return MMD_RBF_cost;
+    return MMDFunctions::transformed_MMD(actual_distribution, Weights, MMDFunctions::RBF_KERNEL);
 }
 
 /*****************************************************
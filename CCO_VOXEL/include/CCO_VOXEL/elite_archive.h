@@ -0,0 +1,133 @@
+/**
+ * Archive of the elites carried over between CEM iterations
+ *
+ * Keeps the coefficients, the positions / accelerations and the cost of the best rollouts of
+ * an iteration together, so that the next iteration splices them into its first rows without
+ * evaluating the basis or the cost again. A cost depends on the map, the execution time and the
+ * boundary conditions only (the collision noise is a draw of the same distribution), so the
+ * archive stays valid across iterations and replans until one of them changes: begin() clears
+ * it when the MapSnapshot version, the execution time or the pinned coefficients differ from
+ * those the entries were costed with.
+ *
+ * A cached cost is the draw of the iteration that costed the rollout; with cache_costs off the
+ * archived rollouts are costed again with the draws of every iteration (the previous behavior).
+ **/
+#pragma once
+
+#include "rollout_buffer.h"
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace Optimizer
+{
+    class EliteArchive
+    {
+    public:
+        static constexpr int PINNED = 3; // coefficients pinned to the boundary conditions at each end
+
+        bool cache_costs = true;
+
+        /** start of a plan, coeffs the (order+1) x 3 A* fit; clears the archive when anything its costs depend on changed **/
+        void begin(uint64_t map_version, double execTime, const Eigen::MatrixXd &coeffs);
+        void clear() { num_entries = 0; }
+
+        int size() const { return num_entries; }
+        double cost(int entry) const { return costs(entry); }
+        Eigen::MatrixXd coefficients(int entry) const; // (order+1) x 3
+
+        /** replaces the entries by the first count elites (rows of coeffs / rollouts, cheapest first) **/
+        void store(const std::vector<Eigen::MatrixXd> &coeffs, const RolloutBuffer &rollouts, const std::vector<double> &sample_costs, const std::vector<int> &indices, int count);
+
+        /** coefficients of the entries into rows [0, size()) of coeffs **/
+        void restore_coefficients(std::vector<Eigen::MatrixXd> &coeffs) const;
+
+        /** positions, accelerations and costs of the entries into rows [0, size()) **/
+        void restore_rollouts(RolloutBuffer &rollouts, std::vector<double> &sample_costs) const;
+
+    private:
+        RolloutBuffer::Plane coeff[3], pos[3], acc[3];
+        Eigen::VectorXd costs;
+        int num_entries = 0;
+
+        uint64_t map_version = 0;
+        double exec_time = -1;
+        Eigen::MatrixXd boundary; // pinned coefficients of the entries, 2 * PINNED x 3
+    };
+}
+
+inline void Optimizer::EliteArchive::begin(uint64_t map_version_, double execTime, const Eigen::MatrixXd &coeffs)
+{
+    Eigen::MatrixXd pinned(2 * PINNED, 3);
+    pinned << coeffs.topRows(PINNED), coeffs.bottomRows(PINNED);
+
+    if (map_version_ != map_version || execTime != exec_time || boundary.rows() != pinned.rows() || boundary != pinned)
+    {
+        clear();
+    }
+
+    map_version = map_version_;
+    exec_time = execTime;
+    boundary = pinned;
+}
+
+inline Eigen::MatrixXd Optimizer::EliteArchive::coefficients(int entry) const
+{
+    Eigen::MatrixXd coeffs(coeff[0].cols(), 3);
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        coeffs.col(axis) = coeff[axis].row(entry).transpose();
+    }
+
+    return coeffs;
+}
+
+inline void Optimizer::EliteArchive::store(const std::vector<Eigen::MatrixXd> &coeffs, const RolloutBuffer &rollouts, const std::vector<double> &sample_costs, const std::vector<int> &indices, int count)
+{
+    num_entries = std::max(0, std::min(count, int(indices.size())));
+    costs.resize(num_entries);
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        coeff[axis].resize(num_entries, coeffs.at(axis).cols());
+        pos[axis].resize(num_entries, rollouts.points());
+        acc[axis].resize(num_entries, rollouts.points());
+
+        for (int e = 0; e < num_entries; e++)
+        {
+            coeff[axis].row(e) = coeffs.at(axis).row(indices.at(e));
+            pos[axis].row(e) = rollouts.pos[axis].row(indices.at(e));
+            acc[axis].row(e) = rollouts.acc[axis].row(indices.at(e));
+        }
+    }
+
+    for (int e = 0; e < num_entries; e++)
+    {
+        costs(e) = sample_costs.at(indices.at(e));
+    }
+}
+
+inline void Optimizer::EliteArchive::restore_coefficients(std::vector<Eigen::MatrixXd> &coeffs) const
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        coeffs.at(axis).topRows(num_entries) = coeff[axis];
+    }
+}
+
+inline void Optimizer::EliteArchive::restore_rollouts(RolloutBuffer &rollouts, std::vector<double> &sample_costs) const
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        rollouts.pos[axis].topRows(num_entries) = pos[axis];
+        rollouts.acc[axis].topRows(num_entries) = acc[axis];
+    }
+
+    for (int e = 0; e < num_entries; e++)
+    {
+        sample_costs.at(e) = costs(e);
+    }
+}
@@ -0,0 +1,104 @@
+/**
+ * Elite selection and distribution fit of the cross entropy optimizer
+ *
+ * select() keeps the num_elites cheapest samples with a partial sort over the sample indices,
+ * ties broken by the index, so every sample is picked at most once even when several share
+ * infCost. The elites are weighted
+ *   UNIFORM  1 / num_elites
+ *   SOFTMAX  exp(-(c_i - c_min) / lambda) normalized (MPPI style), with
+ *            lambda = temperature * (c_worst_elite - c_min) so that the temperature does not
+ *            depend on the scale of the costs; equal costs fall back to uniform weights
+ * fit() returns the weighted mean and variance of the elite rows of a (samples x dims) matrix,
+ * e.g. the perturbed Bernstein coefficients of one axis.
+ **/
+#pragma once
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <string>
+#include <vector>
+
+namespace Optimizer
+{
+    class EliteSelection
+    {
+    public:
+        enum Weighting
+        {
+            UNIFORM,
+            SOFTMAX
+        };
+
+        Weighting weighting = UNIFORM;
+        double temperature = 1.0; // SOFTMAX only, relative to the cost spread of the elites
+
+        std::vector<int> indices; // elites, cheapest first
+        Eigen::VectorXd weights;  // weight of indices[i], sums to 1
+
+        static Weighting weighting_from_string(const std::string &name);
+
+        void select(const std::vector<double> &costs, int num_elites);
+        void fit(const Eigen::MatrixXd &samples, Eigen::RowVectorXd &mean, Eigen::RowVectorXd &variance) const;
+
+    private:
+        std::vector<int> order; // scratch of select
+    };
+}
+
+inline Optimizer::EliteSelection::Weighting Optimizer::EliteSelection::weighting_from_string(const std::string &name)
+{
+    if (name == "softmax" || name == "mppi")
+        return SOFTMAX;
+
+    return UNIFORM;
+}
+
+inline void Optimizer::EliteSelection::select(const std::vector<double> &costs, int num_elites)
+{
+    num_elites = std::max(1, std::min(num_elites, int(costs.size())));
+
+    order.resize(costs.size());
+    std::iota(order.begin(), order.end(), 0);
+
+    std::partial_sort(order.begin(), order.begin() + num_elites, order.end(), [&](int a, int b)
+                      { return costs[a] < costs[b] || (costs[a] == costs[b] && a < b); });
+
+    indices.assign(order.begin(), order.begin() + num_elites);
+    weights.resize(num_elites);
+
+    double best = costs[indices.front()];
+    double spread = costs[indices.back()] - best;
+
+    if (weighting == UNIFORM || !(spread > 0) || !std::isfinite(spread))
+    {
+        weights.setConstant(1.0 / num_elites);
+        return;
+    }
+
+    double lambda = temperature * spread;
+
+    for (int i = 0; i < num_elites; i++)
+    {
+        weights(i) = std::exp(-(costs[indices[i]] - best) / lambda);
+    }
+
+    weights /= weights.sum();
+}
+
+inline void Optimizer::EliteSelection::fit(const Eigen::MatrixXd &samples, Eigen::RowVectorXd &mean, Eigen::RowVectorXd &variance) const
+{
+    mean = Eigen::RowVectorXd::Zero(samples.cols());
+    variance = Eigen::RowVectorXd::Zero(samples.cols());
+
+    for (int i = 0; i < int(indices.size()); i++)
+    {
+        mean += weights(i) * samples.row(indices[i]);
+    }
+
+    for (int i = 0; i < int(indices.size()); i++)
+    {
+        variance += weights(i) * (samples.row(indices[i]) - mean).array().square().matrix();
+    }
+}
@@ -0,0 +1,276 @@
+/**
+ * Gradient based backend of the trajectory optimizer
+ *
+ * L-BFGS over the free Bernstein coefficients (the first and last three of every axis are
+ * pinned to the boundary conditions and stay as given) of the objective
+ *   collision_weight    * sum_i field(p_i)                                   (trilinear cost field)
+ *   stability_weight    * sum_i (|a_i| - amin)(|a_i| - amax) outside [amin, amax]
+ *   elastic_band_weight * sum_i |p_(i-1) - 2 p_i + p_(i+1)|
+ *   smoothness_weight   * sum_i |p_i - p_(i-1)|^2 / t_i^5
+ * with p = P c and a = Pddot c; the terms and weights are those of the CEM rollout cost
+ * (costPerTrajectory and RolloutCosts, which have no smoothness term), the smoothness weight 0
+ * keeps it identical to it. The gradient is formed on the waypoints and pulled back through the
+ * basis,
+ *   dJ/dc = P^T dJ/dp + Pddot^T dJ/da.
+ * Every iteration takes the two-loop L-BFGS direction (steepest descent when it is not a
+ * descent direction) and a backtracking Armijo line search; it stops after max_iterations,
+ * when the line search fails or when the objective improves by less than tolerance (relative).
+ **/
+#pragma once
+
+#include "cost_field.h"
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace Optimizer
+{
+    enum Backend
+    {
+        CEM,       // sampling only
+        CEM_LBFGS, // the best CEM rollout polished with L-BFGS
+        LBFGS      // L-BFGS from the A* fit (or the warm started mean)
+    };
+
+    inline Backend backend_from_string(const std::string &name)
+    {
+        if (name == "cem+lbfgs" || name == "polish")
+            return CEM_LBFGS;
+
+        if (name == "lbfgs" || name == "gradient")
+            return LBFGS;
+
+        return CEM;
+    }
+
+    class GradientOptimizer
+    {
+    public:
+        static constexpr int PINNED = 3; // coefficients pinned at each end
+
+        int max_iterations = 30;
+        int memory = 6; // correction pairs of L-BFGS
+        double tolerance = 1e-6;
+        double field_resolution = 0.2; // [m] of the collision cost field
+
+        double collision_weight = 1.0;
+        double stability_weight = 0.5;
+        double elastic_band_weight = 0.001;
+        double smoothness_weight = 0.0;
+        double amin = -1.0; // acceptable acceleration norm
+        double amax = 1.5;
+
+        /** minimizes over the free coefficients of coeffs ((order+1) x 3, in / out), returns the final objective **/
+        double optimize(const Eigen::MatrixXd &P, const Eigen::MatrixXd &Pddot, double execTime, const Map3D::CostField &field, Eigen::MatrixXd &coeffs);
+
+        /** objective at coeffs and, when gradient is not null, its gradient ((order+1) x 3, zero on the pinned rows) **/
+        double objective(const Eigen::MatrixXd &P, const Eigen::MatrixXd &Pddot, const Map3D::CostField &field, const Eigen::MatrixXd &coeffs, Eigen::MatrixXd *gradient);
+
+        int iterations() const { return num_iterations; }   // of the last optimize()
+        int evaluations() const { return num_evaluations; } // objective evaluations of the last optimize()
+        double initial_objective() const { return first_objective; }
+
+    private:
+        void set_time_weights(int num_points, double execTime);
+
+        Eigen::VectorXd time_weights; // 1 / t_i^5, i >= 1
+        Eigen::MatrixXd pos, acc, dpos, dacc;
+        int num_iterations = 0;
+        int num_evaluations = 0;
+        double first_objective = 0;
+    };
+}
+
+inline void Optimizer::GradientOptimizer::set_time_weights(int num_points, double execTime)
+{
+    time_weights.resize(std::max(0, num_points - 1));
+
+    for (int i = 1; i < num_points; i++)
+    {
+        time_weights(i - 1) = 1.0 / std::pow(double(i) / double(num_points - 1) * execTime, 5);
+    }
+}
+
+inline double Optimizer::GradientOptimizer::objective(const Eigen::MatrixXd &P, const Eigen::MatrixXd &Pddot, const Map3D::CostField &field, const Eigen::MatrixXd &coeffs, Eigen::MatrixXd *gradient)
+{
+    int n = int(P.rows());
+
+    pos.noalias() = P * coeffs; // n x 3
+    acc.noalias() = Pddot * coeffs;
+    dpos.setZero(n, 3);
+    dacc.setZero(n, 3);
+
+    double cost = 0;
+    Eigen::Vector3d grad;
+
+    for (int i = 0; i < n; i++)
+    {
+        cost += collision_weight * field.value(pos.row(i).transpose(), gradient ? &grad : nullptr);
+
+        if (gradient)
+            dpos.row(i) += collision_weight * grad.transpose();
+
+        double a = acc.row(i).norm();
+
+        if ((a > amax || a < amin) && a > 0)
+        {
+            cost += stability_weight * (a - amin) * (a - amax);
+            dacc.row(i) += stability_weight * (2 * a - amin - amax) / a * acc.row(i);
+        }
+    }
+
+    for (int i = 1; i + 1 < n; i++)
+    {
+        Eigen::RowVector3d bend = pos.row(i - 1) - 2 * pos.row(i) + pos.row(i + 1);
+        double length = bend.norm();
+
+        cost += elastic_band_weight * length;
+
+        if (length > 1e-12)
+        {
+            Eigen::RowVector3d u = elastic_band_weight / length * bend;
+
+            dpos.row(i - 1) += u;
+            dpos.row(i) -= 2 * u;
+            dpos.row(i + 1) += u;
+        }
+    }
+
+    if (smoothness_weight > 0)
+    {
+        for (int i = 1; i < n; i++)
+        {
+            Eigen::RowVector3d step = pos.row(i) - pos.row(i - 1);
+            double w = smoothness_weight * time_weights(i - 1);
+
+            cost += w * step.squaredNorm();
+            dpos.row(i) += 2 * w * step;
+            dpos.row(i - 1) -= 2 * w * step;
+        }
+    }
+
+    if (gradient)
+    {
+        gradient->noalias() = P.transpose() * dpos;
+        gradient->noalias() += Pddot.transpose() * dacc;
+        gradient->topRows(PINNED).setZero();
+        gradient->bottomRows(PINNED).setZero();
+    }
+
+    num_evaluations++;
+
+    return cost;
+}
+
+inline double Optimizer::GradientOptimizer::optimize(const Eigen::MatrixXd &P, const Eigen::MatrixXd &Pddot, double execTime, const Map3D::CostField &field, Eigen::MatrixXd &coeffs)
+{
+    num_iterations = 0;
+    num_evaluations = 0;
+    set_time_weights(int(P.rows()), execTime);
+
+    Eigen::MatrixXd gradient(coeffs.rows(), 3), next_gradient(coeffs.rows(), 3);
+    Eigen::MatrixXd direction, next;
+
+    double cost = objective(P, Pddot, field, coeffs, &gradient);
+    first_objective = cost;
+
+    // correction pairs, the Frobenius product is the inner product of the free coefficients (the pinned rows are zero)
+    std::deque<Eigen::MatrixXd> s_history, y_history;
+    std::deque<double> rho_history;
+    int capacity = std::max(1, memory);
+    std::vector<double> alpha(capacity);
+
+    for (int iter = 0; iter < max_iterations; iter++)
+    {
+        // two-loop recursion
+        direction = -gradient;
+
+        for (int m = int(s_history.size()) - 1; m >= 0; m--)
+        {
+            alpha[m] = rho_history[m] * (s_history[m].cwiseProduct(direction)).sum();
+            direction -= alpha[m] * y_history[m];
+        }
+
+        if (!s_history.empty())
+        {
+            direction *= (s_history.back().cwiseProduct(y_history.back())).sum() / y_history.back().squaredNorm();
+        }
+
+        for (int m = 0; m < int(s_history.size()); m++)
+        {
+            double beta = rho_history[m] * (y_history[m].cwiseProduct(direction)).sum();
+            direction += (alpha[m] - beta) * s_history[m];
+        }
+
+        double slope = (gradient.cwiseProduct(direction)).sum();
+
+        if (!(slope < 0))
+        {
+            s_history.clear();
+            y_history.clear();
+            rho_history.clear();
+
+            direction = -gradient;
+            slope = -gradient.squaredNorm();
+        }
+
+        if (slope > -1e-16)
+            break;
+
+        // backtracking, the first L-BFGS step is unscaled so it starts from a step of about the grid resolution
+        double step = s_history.empty() ? std::min(1.0, field_resolution / std::sqrt(direction.squaredNorm())) : 1.0;
+        double next_cost = cost;
+        bool accepted = false;
+
+        for (int attempt = 0; attempt < 20; attempt++)
+        {
+            next = coeffs + step * direction;
+            next_cost = objective(P, Pddot, field, next, &next_gradient);
+
+            if (next_cost <= cost + 1e-4 * step * slope)
+            {
+                accepted = true;
+                break;
+            }
+
+            step *= 0.5;
+        }
+
+        if (!accepted)
+            break;
+
+        Eigen::MatrixXd s = next - coeffs;
+        Eigen::MatrixXd y = next_gradient - gradient;
+        double sy = (s.cwiseProduct(y)).sum();
+
+        if (sy > 1e-12)
+        {
+            if (int(s_history.size()) == capacity)
+            {
+                s_history.pop_front();
+                y_history.pop_front();
+                rho_history.pop_front();
+            }
+
+            s_history.push_back(s);
+            y_history.push_back(y);
+            rho_history.push_back(1.0 / sy);
+        }
+
+        double improvement = cost - next_cost;
+
+        coeffs = next;
+        gradient = next_gradient;
+        cost = next_cost;
+        num_iterations = iter + 1;
+
+        if (improvement <= tolerance * std::max(1.0, std::abs(cost)))
+            break;
+    }
+
+    return cost;
+}
@@ -0,0 +1,60 @@
+/**
+ * Seeds of the multi-modal cross entropy optimizer
+ *
+ * Mode 0 is the A* path itself, mode k > 0 the path pushed sideways by a bump
+ *   offset * ceil(k / 4) * sin(pi * s) * direction
+ * with s the arc length fraction (so both ends stay where they are) and direction cycling
+ * through left, right, up and down of the start -> end line. Seeds on different sides of an
+ * obstacle end up in different CEM basins, the modes refine each of them independently.
+ **/
+#pragma once
+
+#include <Eigen/Dense>
+#include <cmath>
+#include <vector>
+
+namespace Optimizer
+{
+    inline std::vector<std::vector<Eigen::Vector3d>> lateral_seeds(const std::vector<Eigen::Vector3d> &wayPts, int num_modes, double offset)
+    {
+        std::vector<std::vector<Eigen::Vector3d>> seeds(num_modes, wayPts);
+
+        if (wayPts.size() < 3)
+            return seeds;
+
+        Eigen::Vector3d heading = wayPts.back() - wayPts.front();
+        Eigen::Vector3d left = Eigen::Vector3d::UnitZ().cross(heading);
+
+        if (left.norm() < 1e-6)
+            left = Eigen::Vector3d::UnitY();
+
+        left.normalize();
+
+        Eigen::Vector3d up = heading.cross(left);
+        up = up.norm() < 1e-6 ? Eigen::Vector3d::UnitZ() : up.normalized();
+
+        const Eigen::Vector3d directions[4] = {left, -left, up, -up};
+
+        std::vector<double> arc_length(wayPts.size(), 0.0);
+
+        for (size_t i = 1; i < wayPts.size(); i++)
+        {
+            arc_length[i] = arc_length[i - 1] + (wayPts[i] - wayPts[i - 1]).norm();
+        }
+
+        if (!(arc_length.back() > 0))
+            return seeds;
+
+        for (int k = 1; k < num_modes; k++)
+        {
+            Eigen::Vector3d shift = offset * double((k + 3) / 4) * directions[(k - 1) % 4];
+
+            for (size_t i = 1; i + 1 < wayPts.size(); i++)
+            {
+                seeds[k][i] += std::sin(M_PI * arc_length[i] / arc_length.back()) * shift;
+            }
+        }
+
+        return seeds;
+    }
+}
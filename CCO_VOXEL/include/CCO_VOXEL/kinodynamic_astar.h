@@ -1,6 +1,9 @@
 #ifndef _KINODYNAMIC_ASTAR_H
 #define _KINODYNAMIC_ASTAR_H
 #include "CCO_VOXEL/utils.h"
+#include "CCO_VOXEL/MMD_lookup_table.h"
+#include "CCO_VOXEL/qmc_noise.h"
+#include "CCO_VOXEL/map_snapshot.h"
 
 #include <Eigen/Eigen>
 #include <iostream>
@@ -51,6 +54,18 @@ namespace fast_planner
 
   typedef PathNode *PathNodePtr; // pointer to path nodes
 
+  /* feasible edge of the node being expanded, waiting for its MMD cost */
+  struct EdgeCandidate
+  {
+    Eigen::Vector3d input;
+    double tau;
+    Eigen::Matrix<double, 6, 1> state;
+    Eigen::Vector3i index;
+    int time_idx;
+    float distance_end = 0;
+    float delta_MMD = 0;
+  };
+
   class NodeComparator
   {
   public:
@@ -130,9 +145,9 @@ namespace fast_planner
     Eigen::Vector3d start_vel_, end_vel_, start_acc_;
     Eigen::Matrix<double, 6, 6> phi_; // state transit matrix
 
-    DynamicEDTOctomap *OctoEDT; // pointer to the EDT of Octomap
-    octomap::OcTree *octomap_tree;
-    octomap::AbstractOcTree *abstract_tree;
+    Map3D::MapSnapshotPtr map_;     // map of the current search, keeps the EDT alive
+    const DynamicEDTOctomap *OctoEDT; // pointer to the EDT of Octomap
+    const octomap::OcTree *octomap_tree; // of map_
     bool is_shot_succ_ = false;
     Eigen::MatrixXd coef_shot_;
     double t_shot_;
@@ -151,6 +166,10 @@ namespace fast_planner
     int allocate_num_;
     int check_num_;
     double tie_breaker_ = 1.0 + 1.0 / 10000;
+    bool use_mmd_lut_ = true; // serve the edge MMD from a distance table instead of the sampled estimator
+    // table of the noise distribution, which is drawn per map version: built once per snapshot and kept in it
+    std::shared_ptr<const MMDFunctions::MMD_lookup_table> mmd_table_;
+    RandomStreams::NoiseSampling noise_sampling_ = RandomStreams::PSEUDO_RANDOM;
 
     /* map */
     double resolution_, inv_resolution_, time_resolution_, inv_time_resolution_;
@@ -196,7 +215,7 @@ namespace fast_planner
                visualization_msgs::MarkerArray A_star_vis, ros::Publisher A_star_pub, std::string path_to_weights, bool dynamic = false,
                double time_start = -1.0); // main function which starts the Kinodynamic Planner
 
-    void setEnvironment(DynamicEDTOctomap *ptr, octomap::OcTree *octomap_tree, octomap::AbstractOcTree *abstract_tree, octomap::point3d map_start_pt, octomap::point3d map_end_pt);
+    void setEnvironment(const Map3D::MapSnapshotPtr &map);
 
     std::vector<Eigen::Vector3d> getKinoTraj(double delta_t); // this is used to get the kinodynamic trajectory
 
@@ -0,0 +1,109 @@
+/**
+ * Read-only snapshot of the map used for cost evaluation
+ *
+ * Bundles what the planners read from the map in one update: the EDT, the octree it was built
+ * from and the window [start, end] it covers. A snapshot never changes after create(), it is
+ * handed around as a MapSnapshotPtr (shared_ptr to const) so passing it costs a reference count,
+ * and every snapshot gets a new version() so caches can tell map updates apart.
+ *
+ * The snapshot shares the ownership of the EDT and of the octree it was built from (the EDT
+ * reads the octree too), so a new octomap message never frees a tree a snapshot still uses.
+ *
+ * What is derived from the map and a fixed noise model (the MMD tables of the optimizer and of
+ * the search, the cost field of the gradient backend) is kept in the snapshot too: derived()
+ * builds it for the first consumer that asks and hands the same object to every later one, so
+ * the modes of the optimizer and repeated searches build it once per map version.
+ **/
+#pragma once
+
+#include <octomap/octomap.h>
+#include <dynamicEDT3D/dynamicEDTOctomap.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace Map3D
+{
+    class MapSnapshot;
+    typedef std::shared_ptr<const MapSnapshot> MapSnapshotPtr;
+
+    class MapSnapshot
+    {
+    public:
+        static MapSnapshotPtr create(std::shared_ptr<const DynamicEDTOctomap> edt, std::shared_ptr<const octomap::OcTree> tree, const octomap::point3d &start, const octomap::point3d &end);
+
+        const DynamicEDTOctomap *edt() const { return edt_.get(); }
+        const octomap::OcTree *tree() const { return tree_.get(); }
+        const octomap::point3d &start() const { return start_; }
+        const octomap::point3d &end() const { return end_; }
+        uint64_t version() const { return version_; }
+
+        /** inside the EDT window **/
+        bool isInMap(const octomap::point3d &pt) const;
+
+        /** EDT distance, negative outside the window **/
+        float distance(const octomap::point3d &pt) const { return edt_->getDistance(pt); }
+
+        /**
+         * Data derived from this snapshot, built by build() on the first call for key and shared
+         * afterwards. key must name every setting the data depends on besides the map, and a key
+         * always holds the same type T. Thread safe, concurrent callers wait for the build.
+         **/
+        template <typename T>
+        std::shared_ptr<const T> derived(const std::string &key, const std::function<std::shared_ptr<const T>()> &build) const;
+
+    private:
+        MapSnapshot() = default;
+
+        std::shared_ptr<const DynamicEDTOctomap> edt_;
+        std::shared_ptr<const octomap::OcTree> tree_;
+        octomap::point3d start_, end_;
+        uint64_t version_ = 0;
+
+        mutable std::recursive_mutex derived_mutex_; // a build may ask for the data it depends on
+        mutable std::map<std::string, std::shared_ptr<const void>> derived_;
+    };
+}
+
+inline Map3D::MapSnapshotPtr Map3D::MapSnapshot::create(std::shared_ptr<const DynamicEDTOctomap> edt, std::shared_ptr<const octomap::OcTree> tree, const octomap::point3d &start, const octomap::point3d &end)
+{
+    static std::atomic<uint64_t> next_version{1};
+
+    std::shared_ptr<MapSnapshot> snapshot(new MapSnapshot());
+
+    snapshot->edt_ = std::move(edt);
+    snapshot->tree_ = std::move(tree);
+    snapshot->start_ = start;
+    snapshot->end_ = end;
+    snapshot->version_ = next_version++;
+
+    return snapshot;
+}
+
+inline bool Map3D::MapSnapshot::isInMap(const octomap::point3d &pt) const
+{
+    return start_.x() <= pt.x() && pt.x() <= end_.x() &&
+           start_.y() <= pt.y() && pt.y() <= end_.y() &&
+           start_.z() <= pt.z() && pt.z() <= end_.z();
+}
+
+template <typename T>
+std::shared_ptr<const T> Map3D::MapSnapshot::derived(const std::string &key, const std::function<std::shared_ptr<const T>()> &build) const
+{
+    std::lock_guard<std::recursive_mutex> lock(derived_mutex_);
+
+    auto found = derived_.find(key);
+
+    if (found != derived_.end())
+        return std::static_pointer_cast<const T>(found->second);
+
+    std::shared_ptr<const T> built = build();
+    derived_[key] = built;
+
+    return built;
+}
@@ -0,0 +1,158 @@
+/**
+ * Counter based random streams (Philox4x32-10)
+ *
+ * A stream is a pure function of (seed, purpose, epoch, iteration, sample, point): the key is
+ * derived from the process seed, the purpose and the epoch (replan / search / map update count),
+ * the counter from the block index and the (iteration, sample, point) ids. Nothing is stateful,
+ * so streams can be drawn from any thread in any order and the same ids always give the same
+ * values for a given seed.
+ *
+ * Normals use Box-Muller on chunks of 64 values held in fixed-size Eigen arrays, so the log,
+ * sqrt, sin and cos are vectorized and nothing is allocated on the heap.
+ **/
+#pragma once
+
+#include <Eigen/Dense>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <random>
+#include <algorithm>
+
+namespace RandomStreams
+{
+    enum StreamPurpose : uint32_t
+    {
+        CEM_COLLISION = 1, // distance distribution of every waypoint of every rollout
+        CEM_TABLE,         // noise draw tabulated by the optimizer's MMD lookup table
+        ASTAR_NOISE,       // mixture noise of KinodynamicAstar::search
+        MAP_NOISE,         // noise of MMD_Map_Functions::update_MMD_Map
+        POINTCLOUD_NOISE,  // pcNoise
+        CEM_COEFFS         // correlated coefficient perturbations of the optimizer, see coefficient_covariance.h
+    };
+
+    typedef std::array<uint32_t, 4> PhiloxBlock;
+
+    /** Philox4x32 with 10 rounds (Salmon et al., Random123) **/
+    inline PhiloxBlock philox4x32(PhiloxBlock counter, uint32_t key0, uint32_t key1)
+    {
+        for (int round = 0; round < 10; round++)
+        {
+            uint64_t product0 = uint64_t(0xD2511F53u) * counter[0];
+            uint64_t product1 = uint64_t(0xCD9E8D57u) * counter[2];
+
+            counter = {uint32_t(product1 >> 32) ^ counter[1] ^ key0, uint32_t(product1),
+                       uint32_t(product0 >> 32) ^ counter[3] ^ key1, uint32_t(product0)};
+
+            key0 += 0x9E3779B9u;
+            key1 += 0xBB67AE85u;
+        }
+
+        return counter;
+    }
+
+    /** uniform in (0, 1), never 0 so that it can go through log **/
+    inline float to_unit_float(uint32_t bits)
+    {
+        return (float(bits >> 8) + 0.5f) * (1.0f / 16777216.0f);
+    }
+
+    inline std::atomic<uint64_t> &seed_storage()
+    {
+        static std::atomic<uint64_t> seed{0};
+        return seed;
+    }
+
+    /** process seed, drawn from std::random_device the first time unless set_seed was called **/
+    inline uint64_t seed()
+    {
+        uint64_t current = seed_storage().load();
+
+        if (current == 0)
+        {
+            std::random_device rd;
+            uint64_t drawn = (uint64_t(rd()) << 32) | rd() | 1;
+            seed_storage().compare_exchange_strong(current, drawn);
+            current = seed_storage().load();
+        }
+
+        return current;
+    }
+
+    /** fix the process seed for reproducible runs, 0 keeps the random default **/
+    inline void set_seed(uint64_t value)
+    {
+        if (value != 0)
+            seed_storage().store(value);
+    }
+
+    class Stream
+    {
+    public:
+        Stream(StreamPurpose purpose, uint32_t epoch, uint32_t iteration = 0, uint32_t sample = 0, uint32_t point = 0)
+            : point_(point), sample_(sample), iteration_(iteration)
+        {
+            uint64_t process_seed = seed();
+
+            key0_ = uint32_t(process_seed) ^ (uint32_t(purpose) * 0x9E3779B9u);
+            key1_ = uint32_t(process_seed >> 32) ^ (epoch * 0x85EBCA6Bu);
+        }
+
+        PhiloxBlock block(uint32_t index) const
+        {
+            return philox4x32({index, point_, sample_, iteration_}, key0_, key1_);
+        }
+
+        /** n uniforms in (0, 1) **/
+        void fill_uniform(float *out, int n) const
+        {
+            for (int b = 0; 4 * b < n; b++)
+            {
+                PhiloxBlock bits = block(uint32_t(b));
+
+                for (int w = 0; w < 4 && 4 * b + w < n; w++)
+                {
+                    out[4 * b + w] = to_unit_float(bits[w]);
+                }
+            }
+        }
+
+        /** n normals N(mean, stddev^2) **/
+        void fill_normal(float *out, int n, float mean, float stddev) const
+        {
+            const int CHUNK_BLOCKS = 16; // 64 values per chunk
+            Eigen::Array<float, 2 * CHUNK_BLOCKS, 1> u1, u2, radius, angle;
+
+            for (int first_block = 0; 4 * first_block < n; first_block += CHUNK_BLOCKS)
+            {
+                for (int b = 0; b < CHUNK_BLOCKS; b++)
+                {
+                    PhiloxBlock bits = block(uint32_t(first_block + b));
+
+                    u1(2 * b) = to_unit_float(bits[0]);
+                    u2(2 * b) = to_unit_float(bits[1]);
+                    u1(2 * b + 1) = to_unit_float(bits[2]);
+                    u2(2 * b + 1) = to_unit_float(bits[3]);
+                }
+
+                radius = stddev * (-2.0f * u1.log()).sqrt();
+                angle = float(2.0 * M_PI) * u2;
+
+                Eigen::Array<float, 2 * CHUNK_BLOCKS, 1> cos_part = radius * angle.cos() + mean;
+                Eigen::Array<float, 2 * CHUNK_BLOCKS, 1> sin_part = radius * angle.sin() + mean;
+
+                int offset = 4 * first_block;
+                int count = std::min(4 * CHUNK_BLOCKS, n - offset);
+
+                for (int i = 0; i < count; i++)
+                {
+                    out[offset + i] = (i % 2 == 0) ? cos_part(i / 2) : sin_part(i / 2);
+                }
+            }
+        }
+
+    private:
+        uint32_t key0_, key1_;
+        uint32_t point_, sample_, iteration_;
+    };
+}
@@ -0,0 +1,58 @@
+/**
+ * Structure-of-arrays buffer of the CEM rollouts
+ *
+ * One row per rollout, one column per waypoint, one plane per axis for the positions and the
+ * accelerations. Planes are row major so that a rollout is contiguous in every plane. The
+ * Bernstein basis is evaluated straight into the planes (one GEMM per plane) and the cost
+ * kernels read them in place. resize() only reallocates when the shape changes, so the buffer
+ * is reused across iterations and replans.
+ **/
+#pragma once
+
+#include <Eigen/Dense>
+#include <vector>
+
+namespace Optimizer
+{
+    class RolloutBuffer
+    {
+    public:
+        typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> Plane;
+
+        Plane pos[3]; // x, y, z of every waypoint
+        Plane acc[3];
+
+        void resize(int num_rollouts, int num_points);
+        int rows() const { return int(pos[0].rows()); }
+        int points() const { return int(pos[0].cols()); }
+
+        /** positions / accelerations of rows [first_row, first_row + coeffs.rows()) from per-axis coefficients (rows x order+1) **/
+        void evaluate(const Eigen::MatrixXd &P, const Eigen::MatrixXd &Pddot, const std::vector<Eigen::MatrixXd> &coeffs, int first_row = 0);
+
+        Eigen::Vector3d position(int row, int point) const { return Eigen::Vector3d(pos[0](row, point), pos[1](row, point), pos[2](row, point)); }
+        Eigen::Vector3d acceleration(int row, int point) const { return Eigen::Vector3d(acc[0](row, point), acc[1](row, point), acc[2](row, point)); }
+    };
+}
+
+inline void Optimizer::RolloutBuffer::resize(int num_rollouts, int num_points)
+{
+    if (rows() == num_rollouts && points() == num_points)
+        return;
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        pos[axis].resize(num_rollouts, num_points);
+        acc[axis].resize(num_rollouts, num_points);
+    }
+}
+
+inline void Optimizer::RolloutBuffer::evaluate(const Eigen::MatrixXd &P, const Eigen::MatrixXd &Pddot, const std::vector<Eigen::MatrixXd> &coeffs, int first_row)
+{
+    int num_rows = int(coeffs.at(0).rows());
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        pos[axis].middleRows(first_row, num_rows).noalias() = coeffs.at(axis) * P.transpose();
+        acc[axis].middleRows(first_row, num_rows).noalias() = coeffs.at(axis) * Pddot.transpose();
+    }
+}
@@ -0,0 +1,69 @@
+/**
+ * Batched dynamics costs of the CEM rollouts
+ *
+ * evaluate() computes, for a block of rows of a RolloutBuffer at once,
+ *   stability     sum over the waypoints of (|a| - amin)(|a| - amax) outside [amin, amax]
+ *   elastic_band  sum over the inner waypoints of |p(i-1) - 2 p(i) + p(i+1)|
+ * with array expressions over the (rows x waypoints) planes. The second differences are the
+ * differences of consecutive first differences p(i) - p(i-1), formed once per axis.
+ * Results are indexed by the rollout row; the scratch planes are reused across calls.
+ **/
+#pragma once
+
+#include "rollout_buffer.h"
+
+#include <Eigen/Dense>
+
+namespace Optimizer
+{
+    class RolloutCosts
+    {
+    public:
+        double amin = -1.0; // acceptable acceleration norm
+        double amax = 1.5;
+
+        Eigen::VectorXd stability;
+        Eigen::VectorXd elastic_band;
+
+        void evaluate(const RolloutBuffer &rollouts, int first_row, int num_rows);
+
+    private:
+        typedef Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> Block;
+
+        Block diff, bend_sq, acc_sq;
+    };
+}
+
+inline void Optimizer::RolloutCosts::evaluate(const RolloutBuffer &rollouts, int first_row, int num_rows)
+{
+    int n = rollouts.points();
+
+    if (stability.size() != rollouts.rows())
+    {
+        stability.setZero(rollouts.rows());
+        elastic_band.setZero(rollouts.rows());
+    }
+
+    if (num_rows <= 0 || n < 3)
+        return;
+
+    bend_sq.setZero(num_rows, n - 2);
+    acc_sq.setZero(num_rows, n);
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        auto pos = rollouts.pos[axis].middleRows(first_row, num_rows).array();
+
+        diff = pos.rightCols(n - 1) - pos.leftCols(n - 1);
+
+        bend_sq += (diff.rightCols(n - 2) - diff.leftCols(n - 2)).square();
+        acc_sq += rollouts.acc[axis].middleRows(first_row, num_rows).array().square();
+    }
+
+    // acc_sq becomes the stability cost of every waypoint
+    acc_sq = acc_sq.sqrt();
+    acc_sq = (acc_sq > amax || acc_sq < amin).select((acc_sq - amin) * (acc_sq - amax), 0.0);
+
+    stability.segment(first_row, num_rows) = acc_sq.rowwise().sum();
+    elastic_band.segment(first_row, num_rows) = bend_sq.sqrt().rowwise().sum();
+}
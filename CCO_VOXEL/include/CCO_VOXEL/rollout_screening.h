@@ -0,0 +1,173 @@
+/**
+ * Multi-fidelity costing of the CEM rollouts
+ *
+ * Every new rollout of an iteration is first costed with a cheap collision proxy,
+ *   MMD_LUT          the tabulated MMD of the EDT distance (MMD_lookup_table)
+ *   EDT_HINGE_PROXY  hinge_scale * ((2 - d) / 2)^2 below 2 m, hinge_scale the MMD at d = 0
+ * plus the same dynamics terms as the full cost. rank() orders the rollouts by that cost and
+ * only the contenders, the cheapest max(num_elites, fraction * rollouts), get the full sampled
+ * 100-point MMD before the elite selection. The others rank behind every contender.
+ *
+ * record() keeps the rank agreement of the two stages on the contenders: the Spearman
+ * correlation of proxy and full costs and the overlap of the num_elites best by either. With
+ * audit on every rollout gets the full cost for the statistics (the selection still uses the
+ * screened costs), and elite_recall() tells how many of the true elites were contenders.
+ **/
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <string>
+#include <vector>
+
+namespace Optimizer
+{
+    enum CollisionModel
+    {
+        SAMPLED_MMD,   // 100 noise samples per waypoint, batched MMD
+        TABULATED_MMD, // MMD lookup table
+        EDT_HINGE
+    };
+
+    class RolloutScreening
+    {
+    public:
+        enum Proxy
+        {
+            MMD_LUT,
+            EDT_HINGE_PROXY
+        };
+
+        bool enabled = false;
+        double fraction = 0.3; // of the new rollouts that get the full cost, never fewer than the elites
+        Proxy proxy = MMD_LUT;
+        bool audit = false;
+        double hinge_scale = 1.0; // set from the MMD table
+
+        static Proxy proxy_from_string(const std::string &name);
+        CollisionModel proxy_model() const { return proxy == EDT_HINGE_PROXY ? EDT_HINGE : TABULATED_MMD; }
+
+        int contenders(int num_rollouts, int num_elites) const;
+
+        /** rows [first, last) ordered by costs, cheapest first (ties by row) **/
+        const std::vector<int> &rank(const std::vector<double> &costs, int first, int last);
+
+        /** agreement of the proxy and full costs of the first num_contenders rows of the last rank() **/
+        void record(const std::vector<double> &proxy_costs, const std::vector<double> &full_costs, int num_contenders, int num_elites);
+
+        /** audit only: full_costs of every ranked row **/
+        void record_audit(const std::vector<double> &full_costs, int num_contenders, int num_elites);
+
+        void reset();
+
+        double spearman() const { return num_records > 0 ? sum_spearman / num_records : 0.0; }
+        double elite_overlap() const { return num_records > 0 ? sum_overlap / num_records : 0.0; }
+        double elite_recall() const { return num_audits > 0 ? sum_recall / num_audits : 0.0; }
+        int audits() const { return num_audits; }
+
+    private:
+        std::vector<int> order, full_order;
+        std::vector<double> proxy_rank;
+
+        double sum_spearman = 0, sum_overlap = 0, sum_recall = 0;
+        int num_records = 0, num_audits = 0;
+    };
+}
+
+inline Optimizer::RolloutScreening::Proxy Optimizer::RolloutScreening::proxy_from_string(const std::string &name)
+{
+    if (name == "hinge" || name == "edt_hinge")
+        return EDT_HINGE_PROXY;
+
+    return MMD_LUT;
+}
+
+inline int Optimizer::RolloutScreening::contenders(int num_rollouts, int num_elites) const
+{
+    int num_contenders = int(std::ceil(fraction * num_rollouts));
+
+    return std::max(0, std::min(num_rollouts, std::max(num_elites, num_contenders)));
+}
+
+inline const std::vector<int> &Optimizer::RolloutScreening::rank(const std::vector<double> &costs, int first, int last)
+{
+    order.resize(std::max(0, last - first));
+    std::iota(order.begin(), order.end(), first);
+
+    std::sort(order.begin(), order.end(), [&](int a, int b)
+              { return costs[a] < costs[b] || (costs[a] == costs[b] && a < b); });
+
+    return order;
+}
+
+inline void Optimizer::RolloutScreening::record(const std::vector<double> &proxy_costs, const std::vector<double> &full_costs, int num_contenders, int num_elites)
+{
+    int n = std::min(num_contenders, int(order.size()));
+
+    if (n < 2)
+        return;
+
+    // contenders are in proxy order, rank them again by the full cost
+    full_order.assign(order.begin(), order.begin() + n);
+    std::sort(full_order.begin(), full_order.end(), [&](int a, int b)
+              { return full_costs[a] < full_costs[b] || (full_costs[a] == full_costs[b] && a < b); });
+
+    proxy_rank.assign(proxy_costs.size(), 0.0);
+
+    for (int k = 0; k < n; k++)
+        proxy_rank[order[k]] = k;
+
+    double sum_sq = 0;
+    int overlap = 0;
+    int k_elites = std::min(num_elites, n);
+
+    for (int k = 0; k < n; k++)
+    {
+        double d = proxy_rank[full_order[k]] - k;
+        sum_sq += d * d;
+
+        if (k < k_elites && proxy_rank[full_order[k]] < k_elites)
+            overlap++;
+    }
+
+    sum_spearman += 1.0 - 6.0 * sum_sq / (double(n) * (double(n) * n - 1.0));
+    sum_overlap += k_elites > 0 ? double(overlap) / k_elites : 1.0;
+    num_records++;
+}
+
+inline void Optimizer::RolloutScreening::record_audit(const std::vector<double> &full_costs, int num_contenders, int num_elites)
+{
+    int n = int(order.size());
+    int k_elites = std::min(num_elites, n);
+
+    if (k_elites <= 0)
+        return;
+
+    full_order = order;
+    std::partial_sort(full_order.begin(), full_order.begin() + k_elites, full_order.end(), [&](int a, int b)
+                      { return full_costs[a] < full_costs[b] || (full_costs[a] == full_costs[b] && a < b); });
+
+    // order holds the proxy ranking, a true elite was screened in when it is among the first num_contenders
+    proxy_rank.assign(full_costs.size(), 0.0);
+
+    for (int k = 0; k < n; k++)
+        proxy_rank[order[k]] = k;
+
+    int recalled = 0;
+
+    for (int k = 0; k < k_elites; k++)
+    {
+        if (proxy_rank[full_order[k]] < num_contenders)
+            recalled++;
+    }
+
+    sum_recall += double(recalled) / k_elites;
+    num_audits++;
+}
+
+inline void Optimizer::RolloutScreening::reset()
+{
+    sum_spearman = sum_overlap = sum_recall = 0;
+    num_records = num_audits = 0;
+}
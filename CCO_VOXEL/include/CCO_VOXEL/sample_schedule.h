@@ -0,0 +1,75 @@
+/**
+ * Adaptive number of rollouts per cross entropy iteration
+ *
+ * The first iteration draws the ceiling (numSampleTrajs), later ones scale with how much the
+ * sampling distribution has concentrated:
+ *   samples = min_samples + (ceiling - min_samples) * clamp(max stddev / initial max stddev, 0, 1)
+ * and the elites keep the ratio topSamples / numSampleTrajs, never fewer than min_elites (or
+ * the elites carried over to the next iteration). The carried elites fill the first rows of
+ * every iteration, so there is always at least one fresh rollout beyond the elite floor.
+ * Disabled, every iteration uses the ceiling and topSamples, min_elites is not applied.
+ **/
+#pragma once
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+
+namespace Optimizer
+{
+    class SampleSchedule
+    {
+    public:
+        bool enabled = false;
+        int min_samples = 20; // floor, the ceiling is numSampleTrajs (raised to the elite floor + 1)
+        int min_elites = 5;
+
+        /** start of an optimizeTrajectory call, the elite floor is elite_floor, raised to min_elites when enabled **/
+        void start(int max_samples, int max_elites, int elite_floor, const Eigen::Vector3d &initial_stddev);
+
+        /** sampling stddev after the update of the distribution, sets the size of the next iteration **/
+        void update(const Eigen::Vector3d &stddev);
+
+        int samples() const { return num_samples; }
+        int elites() const { return num_elites; }
+
+    private:
+        int max_samples_ = 0, max_elites_ = 0, elite_floor_ = 0;
+        double initial_spread = 0;
+        int num_samples = 0, num_elites = 0;
+
+        void set_samples(int samples);
+    };
+}
+
+inline void Optimizer::SampleSchedule::set_samples(int samples)
+{
+    // the carried elites take the first rows, never fewer rollouts than them plus a new one
+    num_samples = std::max(1, std::min(std::max(samples, elite_floor_ + 1), max_samples_));
+    num_elites = int(std::lround(double(max_elites_) * num_samples / max_samples_));
+    num_elites = std::min(num_samples, std::max(num_elites, elite_floor_));
+}
+
+inline void Optimizer::SampleSchedule::start(int max_samples, int max_elites, int elite_floor, const Eigen::Vector3d &initial_stddev)
+{
+    max_samples_ = max_samples;
+    max_elites_ = max_elites;
+    elite_floor_ = enabled ? std::max(min_elites, elite_floor) : elite_floor;
+    initial_spread = initial_stddev.maxCoeff();
+
+    set_samples(max_samples);
+}
+
+inline void Optimizer::SampleSchedule::update(const Eigen::Vector3d &stddev)
+{
+    if (!enabled || !(initial_spread > 0))
+    {
+        set_samples(max_samples_);
+        return;
+    }
+
+    double spread = std::min(1.0, std::max(0.0, stddev.maxCoeff() / initial_spread));
+    int floor = std::min(min_samples, max_samples_);
+
+    set_samples(floor + int(std::lround((max_samples_ - floor) * spread)));
+}
@@ -0,0 +1,273 @@
+/**
+ * Asynchronous telemetry of the optimizer
+ *
+ * The planning thread records debug values (sampled distances of the mean trajectory, the elite
+ * rollouts of every iteration) into a lock-free single producer / single consumer ring; a
+ * background thread drains it every 1 / rate_hz seconds and hands the batch to the handlers,
+ * which do the ROS serialization and publishing. Recording is a few stores and never blocks or
+ * allocates: when the ring is full the record (or the whole elite frame) is dropped and counted.
+ * Of the elite frames recorded between two drains only the latest is handed on.
+ *
+ * Only one thread may record, records made while the sink is not running are ignored. Building
+ * with -DCCO_VOXEL_TELEMETRY=0 (cmake -DCCO_VOXEL_TELEMETRY=OFF) turns recording into no-ops and
+ * never starts the thread.
+ **/
+#pragma once
+
+#ifndef CCO_VOXEL_TELEMETRY
+#define CCO_VOXEL_TELEMETRY 1
+#endif
+
+#include <Eigen/Dense>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Telemetry
+{
+    /** lock-free ring for one producer and one consumer thread, Capacity a power of two **/
+    template <typename T, size_t Capacity>
+    class SpscRing
+    {
+        static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    public:
+        size_t free_slots() const { return Capacity - (head.load(std::memory_order_relaxed) - tail.load(std::memory_order_acquire)); }
+
+        // producer
+        void push_unchecked(const T &item)
+        {
+            size_t h = head.load(std::memory_order_relaxed);
+            slots[h & (Capacity - 1)] = item;
+            head.store(h + 1, std::memory_order_release);
+        }
+
+        bool push(const T &item)
+        {
+            if (free_slots() == 0)
+                return false;
+
+            push_unchecked(item);
+            return true;
+        }
+
+        // consumer
+        bool pop(T &item)
+        {
+            size_t t = tail.load(std::memory_order_relaxed);
+
+            if (t == head.load(std::memory_order_acquire))
+                return false;
+
+            item = slots[t & (Capacity - 1)];
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+    private:
+        T slots[Capacity];
+        alignas(64) std::atomic<size_t> head{0}; // next slot to write
+        alignas(64) std::atomic<size_t> tail{0}; // next slot to read
+    };
+
+    class Sink
+    {
+    public:
+        typedef std::function<void(const std::vector<float> &values)> DistanceHandler;
+        typedef std::function<void(const Eigen::MatrixXd &X, const Eigen::MatrixXd &Y, const Eigen::MatrixXd &Z)> TrajectoryHandler; // one rollout per row
+
+        Sink() = default;
+        ~Sink() { stop(); }
+
+        Sink(const Sink &) = delete;
+        Sink &operator=(const Sink &) = delete;
+
+        void start(double rate_hz, DistanceHandler on_distances, TrajectoryHandler on_trajectories);
+        void stop(); // drains what is left
+        bool running() const { return worker.joinable(); }
+
+        /** planning thread **/
+        void distance(float value);
+        void trajectories(const Eigen::MatrixXd &X, const Eigen::MatrixXd &Y, const Eigen::MatrixXd &Z, int num_rows);
+
+        unsigned long dropped() const { return num_dropped.load(std::memory_order_relaxed); }
+
+    private:
+        enum Kind : uint16_t
+        {
+            DISTANCE,
+            FRAME_BEGIN, // rows x cols points follow
+            POINT
+        };
+
+        struct Record
+        {
+            uint16_t kind;
+            uint16_t rows;
+            uint32_t cols;
+            float x, y, z;
+        };
+
+        void drain();
+        void worker_loop();
+
+        SpscRing<Record, (1 << 16)> ring;
+        std::atomic<unsigned long> num_dropped{0};
+
+        std::thread worker;
+        std::mutex mutex;
+        std::condition_variable wake;
+        bool stopping = false;
+        std::chrono::duration<double> period{0.1};
+
+        DistanceHandler on_distances;
+        TrajectoryHandler on_trajectories;
+
+        // consumer side, a frame may span two drains
+        std::vector<float> distances;
+        Eigen::MatrixXd frame[3], latest[3];
+        long frame_points = 0, frame_filled = 0;
+    };
+}
+
+inline void Telemetry::Sink::start(double rate_hz, DistanceHandler on_distances_, TrajectoryHandler on_trajectories_)
+{
+#if CCO_VOXEL_TELEMETRY
+    if (running())
+        return;
+
+    on_distances = std::move(on_distances_);
+    on_trajectories = std::move(on_trajectories_);
+    period = std::chrono::duration<double>(1.0 / (rate_hz > 0 ? rate_hz : 10.0));
+    stopping = false;
+
+    worker = std::thread(&Sink::worker_loop, this);
+#endif
+}
+
+inline void Telemetry::Sink::stop()
+{
+    if (!running())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    worker.join();
+}
+
+inline void Telemetry::Sink::distance(float value)
+{
+#if CCO_VOXEL_TELEMETRY
+    if (!running())
+        return;
+
+    if (!ring.push(Record{DISTANCE, 0, 0, value, 0, 0}))
+        num_dropped.fetch_add(1, std::memory_order_relaxed);
+#endif
+}
+
+inline void Telemetry::Sink::trajectories(const Eigen::MatrixXd &X, const Eigen::MatrixXd &Y, const Eigen::MatrixXd &Z, int num_rows)
+{
+#if CCO_VOXEL_TELEMETRY
+    if (!running())
+        return;
+
+    size_t cols = size_t(X.cols());
+    size_t needed = size_t(num_rows) * cols + 1;
+
+    // the whole frame or nothing, so that the consumer never sees half a frame followed by another one
+    if (ring.free_slots() < needed)
+    {
+        num_dropped.fetch_add(needed, std::memory_order_relaxed);
+        return;
+    }
+
+    ring.push_unchecked(Record{FRAME_BEGIN, uint16_t(num_rows), uint32_t(cols), 0, 0, 0});
+
+    for (int i = 0; i < num_rows; i++)
+    {
+        for (size_t j = 0; j < cols; j++)
+        {
+            ring.push_unchecked(Record{POINT, 0, 0, float(X(i, j)), float(Y(i, j)), float(Z(i, j))});
+        }
+    }
+#endif
+}
+
+inline void Telemetry::Sink::drain()
+{
+    Record record;
+    bool new_frame = false;
+
+    distances.clear();
+
+    while (ring.pop(record))
+    {
+        switch (record.kind)
+        {
+        case DISTANCE:
+            distances.push_back(record.x);
+            break;
+
+        case FRAME_BEGIN:
+            for (int axis = 0; axis < 3; axis++)
+                frame[axis].resize(record.rows, record.cols);
+
+            frame_points = long(record.rows) * record.cols;
+            frame_filled = 0;
+            break;
+
+        case POINT:
+            if (frame_filled < frame_points)
+            {
+                long row = frame_filled / frame[0].cols(), col = frame_filled % frame[0].cols();
+
+                frame[0](row, col) = record.x;
+                frame[1](row, col) = record.y;
+                frame[2](row, col) = record.z;
+
+                if (++frame_filled == frame_points)
+                {
+                    for (int axis = 0; axis < 3; axis++)
+                        latest[axis].swap(frame[axis]);
+
+                    new_frame = true;
+                }
+            }
+            break;
+        }
+    }
+
+    if (!distances.empty() && on_distances)
+        on_distances(distances);
+
+    if (new_frame && on_trajectories)
+        on_trajectories(latest[0], latest[1], latest[2]);
+}
+
+inline void Telemetry::Sink::worker_loop()
+{
+    while (true)
+    {
+        bool stop_now;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait_for(lock, period, [&]
+                          { return stopping; });
+            stop_now = stopping;
+        }
+
+        drain();
+
+        if (stop_now)
+            return;
+    }
+}
@@ -3,6 +3,7 @@
 #include<geometry_msgs/PoseStamped.h>
 #include<std_msgs/Int8.h>
 #include<std_msgs/Float64.h>
+#include<std_msgs/Float64MultiArray.h>
 #include<geometry_msgs/Twist.h>
 #include<mavros_msgs/State.h>
 #include<mavros_msgs/SetMode.h>
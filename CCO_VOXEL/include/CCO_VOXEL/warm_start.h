@@ -0,0 +1,125 @@
+/**
+ * Warm start of the cross entropy optimizer across replans
+ *
+ * store() keeps the final mean coefficients, the elites and the returned trajectory of a plan.
+ * seed() moves them to the next plan: the new start is projected on the previous trajectory
+ * (parameter s0), every stored curve is cut at s0 with de Casteljau's algorithm so that its
+ * remaining part is again an order-n Bernstein curve over the whole execution time, and the
+ * first / last three coefficients are replaced by those of the new A* fit so that the
+ * boundary conditions of the new plan hold. The seeded mean is
+ *   (1 - blend) * shifted previous mean + blend * A* fit
+ * on the free coefficients, the seeded elites are the A* fit followed by the shifted elites.
+ *
+ * Nothing is seeded when the new start is further than max_offset from the previous
+ * trajectory or has already passed its end, the caller then starts from the A* fit as before.
+ **/
+#pragma once
+
+#include <Eigen/Dense>
+#include <cmath>
+#include <vector>
+
+namespace Optimizer
+{
+    class WarmStart
+    {
+    public:
+        bool enabled = false;
+        double blend = 0.5;      // weight of the A* fit in the seeded mean
+        double stddev = 3.0;     // initial sampling stddev of a warm started plan (7 when cold)
+        double max_offset = 1.0; // distance of the new start to the previous trajectory [m]
+
+        /** coefficients are (order+1) x 3, path is 3 x points of the returned trajectory **/
+        void store(const Eigen::MatrixXd &mean, const std::vector<Eigen::MatrixXd> &elites, const Eigen::Matrix<double, 3, Eigen::Dynamic> &path);
+        void reset() { valid = false; }
+
+        /**
+         * Seeds the mean and up to num_elites elites for the plan whose A* fit is init
+         * ((order+1) x 3); returns false when there is nothing to warm start from.
+         **/
+        bool seed(const Eigen::MatrixXd &init, int num_elites, Eigen::MatrixXd &mean, std::vector<Eigen::MatrixXd> &seeded_elites) const;
+
+        /** control points of the part [s, 1] of a Bernstein curve, one control point per row **/
+        static Eigen::MatrixXd split_right(const Eigen::MatrixXd &coeffs, double s);
+
+    private:
+        Eigen::MatrixXd shift(const Eigen::MatrixXd &coeffs, const Eigen::MatrixXd &init, double s) const;
+
+        bool valid = false;
+        Eigen::MatrixXd prev_mean;
+        std::vector<Eigen::MatrixXd> prev_elites;
+        Eigen::Matrix<double, 3, Eigen::Dynamic> prev_path;
+    };
+}
+
+inline void Optimizer::WarmStart::store(const Eigen::MatrixXd &mean, const std::vector<Eigen::MatrixXd> &elites, const Eigen::Matrix<double, 3, Eigen::Dynamic> &path)
+{
+    prev_mean = mean;
+    prev_elites = elites;
+    prev_path = path;
+    valid = enabled && path.cols() > 1;
+}
+
+inline Eigen::MatrixXd Optimizer::WarmStart::split_right(const Eigen::MatrixXd &coeffs, double s)
+{
+    int n = int(coeffs.rows()) - 1;
+
+    Eigen::MatrixXd work = coeffs;
+    Eigen::MatrixXd right(coeffs.rows(), coeffs.cols());
+
+    right.row(n) = coeffs.row(n);
+
+    for (int r = 1; r <= n; r++)
+    {
+        for (int i = 0; i <= n - r; i++)
+        {
+            work.row(i) = (1 - s) * work.row(i) + s * work.row(i + 1);
+        }
+
+        right.row(n - r) = work.row(n - r);
+    }
+
+    return right;
+}
+
+inline Eigen::MatrixXd Optimizer::WarmStart::shift(const Eigen::MatrixXd &coeffs, const Eigen::MatrixXd &init, double s) const
+{
+    Eigen::MatrixXd shifted = split_right(coeffs, s);
+
+    // boundary conditions (position, velocity and acceleration at both ends) of the new plan
+    shifted.topRows(3) = init.topRows(3);
+    shifted.bottomRows(3) = init.bottomRows(3);
+
+    return shifted;
+}
+
+inline bool Optimizer::WarmStart::seed(const Eigen::MatrixXd &init, int num_elites, Eigen::MatrixXd &mean, std::vector<Eigen::MatrixXd> &seeded_elites) const
+{
+    if (!enabled || !valid || prev_mean.rows() != init.rows())
+        return false;
+
+    Eigen::Vector3d start = init.row(0).transpose();
+
+    Eigen::Index closest;
+    double offset = std::sqrt((prev_path.colwise() - start).colwise().squaredNorm().minCoeff(&closest));
+
+    if (offset > max_offset || closest >= prev_path.cols() - 1)
+        return false;
+
+    double s0 = double(closest) / double(prev_path.cols() - 1);
+
+    mean = shift(prev_mean, init, s0);
+
+    int free = int(init.rows()) - 6;
+    mean.middleRows(3, free) = (1 - blend) * mean.middleRows(3, free) + blend * init.middleRows(3, free);
+
+    seeded_elites.clear();
+    seeded_elites.push_back(init);
+
+    for (int e = 0; e < int(prev_elites.size()) && int(seeded_elites.size()) < num_elites; e++)
+    {
+        seeded_elites.push_back(shift(prev_elites.at(e), init, s0));
+    }
+
+    return true;
+}
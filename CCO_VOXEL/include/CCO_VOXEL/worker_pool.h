@@ -0,0 +1,159 @@
+/**
+ * Fixed size worker pool
+ *
+ * parallel_for splits [0, n) into size() contiguous chunks, in order, one per worker; the
+ * calling thread runs the first chunk and returns once every chunk is done. The partition only
+ * depends on n and size(), and callers write their results by index, so what gets computed for
+ * an index never depends on the number of threads.
+ **/
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Parallel
+{
+    class WorkerPool
+    {
+    public:
+        // body(begin, end, worker) handles the indices [begin, end), worker in [0, size())
+        typedef std::function<void(int begin, int end, int worker)> RangeBody;
+
+        explicit WorkerPool(int num_threads = 0); // 0 uses every hardware thread
+        ~WorkerPool();
+
+        WorkerPool(const WorkerPool &) = delete;
+        WorkerPool &operator=(const WorkerPool &) = delete;
+
+        int size() const { return int(threads.size()) + 1; }
+        void parallel_for(int n, const RangeBody &body);
+
+    private:
+        void run_chunk(int worker);
+        void worker_loop(int worker);
+
+        std::vector<std::thread> threads;
+        std::mutex mutex;
+        std::condition_variable work_ready;
+        std::condition_variable work_done;
+
+        const RangeBody *current_body = nullptr;
+        int current_n = 0;
+        unsigned long generation = 0; // bumped for every parallel_for
+        int pending = 0;              // workers still running the current job
+        bool stopping = false;
+        std::exception_ptr first_error;
+    };
+}
+
+inline Parallel::WorkerPool::WorkerPool(int num_threads)
+{
+    if (num_threads <= 0)
+        num_threads = std::max(1, int(std::thread::hardware_concurrency()));
+
+    for (int worker = 1; worker < num_threads; worker++)
+    {
+        threads.emplace_back(&WorkerPool::worker_loop, this, worker);
+    }
+}
+
+inline Parallel::WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+
+    for (std::thread &thread : threads)
+        thread.join();
+}
+
+inline void Parallel::WorkerPool::run_chunk(int worker)
+{
+    int begin = int((long(current_n) * worker) / size());
+    int end = int((long(current_n) * (worker + 1)) / size());
+
+    if (begin >= end)
+        return;
+
+    try
+    {
+        (*current_body)(begin, end, worker);
+    }
+    catch (...)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!first_error)
+            first_error = std::current_exception();
+    }
+}
+
+inline void Parallel::WorkerPool::worker_loop(int worker)
+{
+    unsigned long seen_generation = 0;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_ready.wait(lock, [&]
+                            { return stopping || generation != seen_generation; });
+
+            if (stopping)
+                return;
+
+            seen_generation = generation;
+        }
+
+        run_chunk(worker);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending--;
+        }
+        work_done.notify_one();
+    }
+}
+
+inline void Parallel::WorkerPool::parallel_for(int n, const RangeBody &body)
+{
+    if (n <= 0)
+        return;
+
+    if (threads.empty())
+    {
+        body(0, n, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        current_body = &body;
+        current_n = n;
+        pending = int(threads.size());
+        first_error = nullptr;
+        generation++;
+    }
+    work_ready.notify_all();
+
+    run_chunk(0);
+
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        work_done.wait(lock, [&]
+                       { return pending == 0; });
+
+        current_body = nullptr;
+        error = first_error;
+    }
+
+    if (error)
+        std::rethrow_exception(error);
+}
@@ -0,0 +1,112 @@
+/**
+ * MMD kernels compiled once for the whole package, see CCO_VOXEL/MMD_kernels.h
+ **/
+#include "CCO_VOXEL/MMD_kernels.h"
+#include "CCO_VOXEL/MMD_moments.h"
+#include "CCO_VOXEL/MMD_weight_store.h"
+#include "CCO_VOXEL/MMD_rff.h"
+
+
+namespace MMDFunctions
+{
+    /** the polynomial kernel is evaluated from the sample moments (MMD_moments.h), the RBF one in MMD_rbf.cpp **/
+    template <int NumSamples, KernelType Kernel>
+    float MMDKernel<NumSamples, Kernel>::evaluate(const Samples &samples)
+    {
+        if (Kernel == RBF_KERNEL)
+            return rbf_MMD(samples.data(), NumSamples);
+        if (Kernel == RFF_KERNEL)
+            return RandomFourierFeatures::shared()->MMD(samples.data(), NumSamples);
+
+        return polynomial_MMD(samples);
+    }
+
+    template struct MMDKernel<NUM_TRANSFORMED_FEATURES, POLYNOMIAL_KERNEL>;
+    template struct MMDKernel<NUM_TRANSFORMED_FEATURES, RBF_KERNEL>;
+
+    float transformed_MMD(const Eigen::Ref<const Eigen::RowVectorXf> &distribution, const WeightMatrix &weights, KernelType kernel)
+    {
+        eigen_assert(distribution.size() == NUM_DISTRIBUTION_SAMPLES);
+
+        Eigen::Map<const DistanceDistribution> fixed_distribution(distribution.data());
+        Eigen::Matrix<float, 1, NUM_TRANSFORMED_FEATURES> transformed_features;
+
+        transformed_features.noalias() = fixed_distribution * weights;
+
+        if (kernel == RBF_KERNEL)
+            return MMDKernel<NUM_TRANSFORMED_FEATURES, RBF_KERNEL>::evaluate(transformed_features);
+        if (kernel == RFF_KERNEL)
+            return RandomFourierFeatures::shared()->MMD(transformed_features.data(), NUM_TRANSFORMED_FEATURES);
+
+        return MMDKernel<NUM_TRANSFORMED_FEATURES, POLYNOMIAL_KERNEL>::evaluate(transformed_features);
+    }
+
+    void transformed_MMD_batch(const Eigen::Ref<const Eigen::MatrixXf> &distributions, const WeightMatrix &weights, Eigen::VectorXf &mmd_values, KernelType kernel)
+    {
+        MMDBatchScratch scratch;
+
+        transformed_MMD_batch(distributions, weights, scratch, kernel);
+        mmd_values = scratch.values;
+    }
+
+    double transformed_MMD_batch(const Eigen::Ref<const Eigen::MatrixXf> &distributions, const WeightMatrix &weights, MMDBatchScratch &scratch, KernelType kernel)
+    {
+        int rows = int(distributions.rows());
+
+        if (scratch.features.rows() < rows)
+        {
+            scratch.features.resize(rows, NUM_TRANSFORMED_FEATURES);
+            scratch.values.resize(rows);
+        }
+
+        auto features = scratch.features.topRows(rows);
+        auto values = scratch.values.head(rows);
+
+        features.noalias() = distributions * weights; // one GEMM for the whole block
+
+        if (kernel == POLYNOMIAL_KERNEL)
+        {
+            // closed form of MMD_moments.h, the moments in double and vectorized across the rows
+            double n = double(NUM_TRANSFORMED_FEATURES);
+            auto sum = features.cast<double>().array().rowwise().sum();
+            auto sum_sq = features.cast<double>().array().square().rowwise().sum();
+
+            values = (n * n + 2.0 * sum.square() + sum_sq.square() - 2.0 * n + n).cast<float>().matrix();
+        }
+        else
+        {
+            const RandomFourierFeatures *rff = kernel == RFF_KERNEL ? RandomFourierFeatures::shared().get() : nullptr;
+            Eigen::Matrix<float, 1, NUM_TRANSFORMED_FEATURES> row;
+
+            for (int r = 0; r < rows; r++)
+            {
+                row = features.row(r);
+                values(r) = rff ? rff->MMD(row.data(), NUM_TRANSFORMED_FEATURES) : rbf_MMD(row.data(), NUM_TRANSFORMED_FEATURES);
+            }
+        }
+
+        return values.cast<double>().sum();
+    }
+
+    float interpolated_MMD(float dist)
+    {
+        static const float coefficients[7] = {7720.61614034, -12367.93260857, -1541.47268526, 14365.74417541,
+                                              -10918.17820688, 3339.69565025, -373.83984028};
+
+        float result = coefficients[6];
+
+        for (int i = 5; i >= 0; i--)
+        {
+            result = result * dist + coefficients[i];
+        }
+
+        return result;
+    }
+
+    bool load_weights(const std::string &path_to_weights, Eigen::Ref<Eigen::MatrixXf> weights)
+    {
+        std::shared_ptr<const WeightStore> store = WeightStore::load(path_to_weights);
+
+        return store && store->assign_to(weights);
+    }
+}
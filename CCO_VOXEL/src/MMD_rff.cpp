@@ -0,0 +1,149 @@
+/**
+ * Random Fourier Feature MMD, see CCO_VOXEL/MMD_rff.h
+ **/
+#include "CCO_VOXEL/MMD_rff.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <random>
+
+namespace MMDFunctions
+{
+    static std::mutex shared_features_mutex;
+    static std::shared_ptr<const RandomFourierFeatures> shared_features;
+    static std::atomic<unsigned long> shared_generation{0}; // bumped by every (re)configuration
+
+    RandomFourierFeatures::RandomFourierFeatures(int dimension, float bandwidth, unsigned int seed)
+    {
+        std::mt19937 gen(seed);
+        std::uniform_real_distribution<double> shift(0.0, 1.0);
+
+        // the spectral density of the kernel, N(0, 1 / sigma^2), is cut at CUTOFF_SIGMAS / sigma
+        double sigma = bandwidth;
+        double grid_step = CUTOFF_SIGMAS / sigma / double(dimension);
+        double grid_shift = shift(gen);
+
+        step_ = float(grid_step);
+        first_ = float(grid_shift * grid_step);
+        weights_.resize(dimension);
+
+        for (int d = 0; d < dimension; d++)
+        {
+            double omega = (double(d) + grid_shift) * grid_step;
+
+            // both signs of omega, 2 * step * p(omega)
+            weights_(d) = float(2.0 * grid_step * sigma / std::sqrt(2.0 * M_PI) * std::exp(-0.5 * omega * omega * sigma * sigma));
+        }
+    }
+
+    static const int LANES = 16;
+    typedef Eigen::Array<float, LANES, Eigen::Dynamic> LaneSums;
+
+    /** adds exp(i omega_d x) of up to LANES * Chains samples to the lane sums of every frequency d **/
+    template <int Chains>
+    static void accumulate_block(const float *samples, int count, float first, float step, int dims, LaneSums &re_sums, LaneSums &im_sums)
+    {
+        typedef Eigen::Array<float, LANES, Chains> Block;
+
+        Block x = Block::Zero(), valid = Block::Zero();
+
+        Eigen::Map<Eigen::Array<float, LANES * Chains, 1>>(x.data()).head(count) = Eigen::Map<const Eigen::ArrayXf>(samples, count);
+        Eigen::Map<Eigen::Array<float, LANES * Chains, 1>>(valid.data()).head(count).setOnes();
+
+        // the padding lanes start at 0 and stay there
+        Block re = valid * (first * x).cos();
+        Block im = valid * (first * x).sin();
+        Block step_re = (step * x).cos();
+        Block step_im = (step * x).sin();
+
+        for (int d = 0; d < dims; d++)
+        {
+            re_sums.col(d) += re.rowwise().sum();
+            im_sums.col(d) += im.rowwise().sum();
+
+            // the Chains columns are independent recurrences, their products overlap
+            Block next = re * step_re - im * step_im;
+            im = re * step_im + im * step_re;
+            re = next;
+        }
+    }
+
+    float RandomFourierFeatures::MMD(const float *samples, int num_samples) const
+    {
+        // exp(i omega_d x) of the samples, advanced from omega_d to omega_(d+1) by one complex
+        // product with exp(i step x): one sin / cos pair per sample, then register only products.
+        // Every lane keeps its own partial sum per frequency, reduced at the end; the per thread
+        // sums only grow.
+        thread_local LaneSums re_sums, im_sums;
+
+        int dims = int(weights_.size());
+
+        if (re_sums.cols() < dims)
+        {
+            re_sums.resize(LANES, dims);
+            im_sums.resize(LANES, dims);
+        }
+
+        re_sums.leftCols(dims).setZero();
+        im_sums.leftCols(dims).setZero();
+
+        for (int first = 0; first < num_samples; first += 4 * LANES)
+        {
+            int count = std::min(4 * LANES, num_samples - first);
+
+            if (count <= LANES)
+                accumulate_block<1>(samples + first, count, first_, step_, dims, re_sums, im_sums);
+            else if (count <= 2 * LANES)
+                accumulate_block<2>(samples + first, count, first_, step_, dims, re_sums, im_sums);
+            else
+                accumulate_block<4>(samples + first, count, first_, step_, dims, re_sums, im_sums);
+        }
+
+        double mmd = 0;
+        double n = double(num_samples);
+
+        for (int d = 0; d < dims; d++)
+        {
+            // the ideal (all zero) distribution embeds to N + 0 i at every frequency
+            double sum_re = double(re_sums.col(d).sum()) - n;
+            double sum_im = double(im_sums.col(d).sum());
+
+            mmd += double(weights_(d)) * (sum_re * sum_re + sum_im * sum_im);
+        }
+
+        return float(mmd);
+    }
+
+    const std::shared_ptr<const RandomFourierFeatures> &RandomFourierFeatures::shared()
+    {
+        // every thread keeps the features it last saw and only takes the lock after configure()
+        thread_local std::shared_ptr<const RandomFourierFeatures> cached;
+        thread_local unsigned long cached_generation = 0;
+
+        if (cached && cached_generation == shared_generation.load(std::memory_order_acquire))
+            return cached;
+
+        std::lock_guard<std::mutex> lock(shared_features_mutex);
+
+        if (!shared_features)
+        {
+            shared_features = std::make_shared<RandomFourierFeatures>(DEFAULT_DIMENSION);
+            shared_generation.fetch_add(1, std::memory_order_release);
+        }
+
+        cached = shared_features;
+        cached_generation = shared_generation.load(std::memory_order_relaxed);
+
+        return cached;
+    }
+
+    void RandomFourierFeatures::configure(int dimension, float bandwidth, unsigned int seed)
+    {
+        std::lock_guard<std::mutex> lock(shared_features_mutex);
+
+        shared_features = std::make_shared<RandomFourierFeatures>(dimension, bandwidth, seed);
+        shared_generation.fetch_add(1, std::memory_order_release);
+    }
+}
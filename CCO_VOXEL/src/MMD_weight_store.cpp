@@ -0,0 +1,250 @@
+/**
+ * Load-once weight store, see CCO_VOXEL/MMD_weight_store.h
+ **/
+#include "CCO_VOXEL/MMD_weight_store.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace MMDFunctions
+{
+    static const char WEIGHT_FILE_MAGIC[8] = {'C', 'C', 'O', 'W', 'G', 'T', '\0', '\0'};
+
+    static bool ends_with(const std::string &str, const std::string &suffix)
+    {
+        return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    uint64_t weights_checksum(const float *data, size_t count)
+    {
+        const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data);
+        uint64_t hash = 14695981039346656037ULL;
+
+        for (size_t i = 0; i < count * sizeof(float); i++)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+
+        return hash;
+    }
+
+    std::shared_ptr<const WeightStore> WeightStore::load(const std::string &path_to_weights)
+    {
+        static std::mutex stores_mutex;
+        static std::map<std::string, std::shared_ptr<const WeightStore>> stores;
+
+        std::lock_guard<std::mutex> lock(stores_mutex);
+
+        auto it = stores.find(path_to_weights);
+        if (it != stores.end())
+            return it->second;
+
+        std::shared_ptr<WeightStore> store = ends_with(path_to_weights, ".csv") ? parse_csv(path_to_weights) : map_binary(path_to_weights);
+
+        if (!store)
+            return nullptr;
+
+        store->path_ = path_to_weights;
+
+        for (int i = 0; i < store->rows_ * store->cols_; i++)
+        {
+            if (!std::isfinite(store->data_[i]))
+            {
+                std::cout << "Weights " << path_to_weights << ": non finite value at " << i << std::endl;
+                return nullptr;
+            }
+        }
+
+        std::cout << store->rows_ << " " << store->cols_ << "  "
+                  << "Weights loaded from " << path_to_weights << std::endl;
+
+        stores[path_to_weights] = store;
+
+        return store;
+    }
+
+    std::shared_ptr<WeightStore> WeightStore::map_binary(const std::string &path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+
+        if (fd < 0)
+        {
+            std::cout << "Could not open weights " << path << std::endl;
+            return nullptr;
+        }
+
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) != 0 || size_t(file_stat.st_size) < sizeof(WeightFileHeader))
+        {
+            std::cout << "Weights " << path << ": file too small for the header" << std::endl;
+            close(fd);
+            return nullptr;
+        }
+
+        size_t file_size = size_t(file_stat.st_size);
+        void *mapping = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+
+        if (mapping == MAP_FAILED)
+        {
+            std::cout << "Weights " << path << ": mmap failed" << std::endl;
+            return nullptr;
+        }
+
+        std::shared_ptr<WeightStore> store(new WeightStore());
+        store->mapping_ = mapping;
+        store->mapping_size_ = file_size;
+
+        const WeightFileHeader *header = static_cast<const WeightFileHeader *>(mapping);
+        const float *payload = reinterpret_cast<const float *>(static_cast<const char *>(mapping) + sizeof(WeightFileHeader));
+        size_t count = size_t(header->rows) * size_t(header->cols);
+
+        if (std::memcmp(header->magic, WEIGHT_FILE_MAGIC, sizeof(WEIGHT_FILE_MAGIC)) != 0)
+        {
+            std::cout << "Weights " << path << ": not a weight file, convert CSV files with convertWeights" << std::endl;
+            return nullptr;
+        }
+        if (header->version != VERSION)
+        {
+            std::cout << "Weights " << path << ": version " << header->version << ", expected " << VERSION << std::endl;
+            return nullptr;
+        }
+        if (count == 0 || file_size != sizeof(WeightFileHeader) + count * sizeof(float))
+        {
+            std::cout << "Weights " << path << ": size does not match " << header->rows << "x" << header->cols << std::endl;
+            return nullptr;
+        }
+        if (weights_checksum(payload, count) != header->checksum)
+        {
+            std::cout << "Weights " << path << ": checksum mismatch" << std::endl;
+            return nullptr;
+        }
+
+        store->rows_ = int(header->rows);
+        store->cols_ = int(header->cols);
+        store->data_ = payload;
+
+        return store;
+    }
+
+    std::shared_ptr<WeightStore> WeightStore::parse_csv(const std::string &path)
+    {
+        std::ifstream in(path);
+
+        if (!in.is_open())
+        {
+            std::cout << "Could not open weights " << path << std::endl;
+            return nullptr;
+        }
+
+        std::vector<float> values;
+        std::string line;
+        int rows = 0;
+        int cols = 0;
+
+        while (std::getline(in, line))
+        {
+            if (line.empty() || line == "\r")
+                continue;
+
+            const char *ptr = line.c_str();
+            const char *start = ptr;
+            int col = 0;
+
+            for (int i = 0; i <= int(line.length()); i++)
+            {
+                if (ptr[i] == ',' || ptr[i] == '\0')
+                {
+                    values.push_back(float(atof(start)));
+                    col++;
+                    start = ptr + i + 1;
+                }
+            }
+
+            if (rows > 0 && col != cols)
+            {
+                std::cout << "Weights " << path << ": row " << rows << " has " << col << " columns, expected " << cols << std::endl;
+                return nullptr;
+            }
+
+            cols = col;
+            rows++;
+        }
+
+        if (rows == 0)
+        {
+            std::cout << "Weights " << path << ": empty file" << std::endl;
+            return nullptr;
+        }
+
+        std::shared_ptr<WeightStore> store(new WeightStore());
+
+        // values are row major in the file
+        store->owned_ = Eigen::Map<Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>>(values.data(), rows, cols);
+        store->rows_ = rows;
+        store->cols_ = cols;
+        store->data_ = store->owned_.data();
+
+        return store;
+    }
+
+    bool WeightStore::convert_csv(const std::string &csv_path, const std::string &binary_path)
+    {
+        std::shared_ptr<WeightStore> store = parse_csv(csv_path);
+
+        if (!store)
+            return false;
+
+        WeightFileHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, WEIGHT_FILE_MAGIC, sizeof(WEIGHT_FILE_MAGIC));
+        header.version = VERSION;
+        header.rows = uint32_t(store->rows_);
+        header.cols = uint32_t(store->cols_);
+        header.checksum = weights_checksum(store->data_, size_t(store->rows_) * size_t(store->cols_));
+
+        std::ofstream out(binary_path, std::ios::binary | std::ios::trunc);
+
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(store->data_), std::streamsize(sizeof(float) * store->rows_ * store->cols_));
+
+        if (!out.good())
+        {
+            std::cout << "Could not write weights " << binary_path << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool WeightStore::assign_to(Eigen::Ref<Eigen::MatrixXf> weights) const
+    {
+        if (weights.rows() != rows_ || weights.cols() != cols_)
+        {
+            std::cout << "Weights " << path_ << " are " << rows_ << "x" << cols_ << ", expected " << weights.rows() << "x" << weights.cols() << std::endl;
+            return false;
+        }
+
+        weights = matrix();
+
+        return true;
+    }
+
+    WeightStore::~WeightStore()
+    {
+        if (mapping_ != nullptr)
+            munmap(mapping_, mapping_size_);
+    }
+}
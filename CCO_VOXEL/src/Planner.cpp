@@ -89,10 +89,9 @@ bool controller_started = false;
 /** octomap callback **/
 void octomap_cb(const octomap_msgs::Octomap octo)
 {
-    costMap3D.new_tree = octomap_msgs::binaryMsgToMap(octo); // this is the abstract tree for an octomap
+    costMap3D.setTree(octomap_msgs::binaryMsgToMap(octo)); // this is the abstract tree for an octomap, converted to an OcTree
     // MMD_Costmap.new_mmd_tree = octomap_msgs::binaryMsgToMap(octo);
 
-    costMap3D.tree = dynamic_cast<octomap::OcTree *>(costMap3D.new_tree);
     // MMD_Costmap.mmd_tree = dynamic_cast<octomap::OcTree*>(MMD_Costmap.mmd_tree);
 
     // std::cout<<"final tree has "<<costMap3D.tree->getNumLeafNodes()<<" leaves"<<std::endl;
@@ -124,6 +123,9 @@ void goal_pose_cb(const geometry_msgs::PoseStamped pose)
 
     goalPose(2) = 4;
 
+    // the previous plan went somewhere else, in every mode
+    optimizer.resetWarmStart();
+
     // std::cout<<"Enter the height at the goal point ";
     // std::cin>>goalPose(2);
 
@@ -229,13 +231,16 @@ void plan(ros::Publisher path, ros::Publisher map, ros::Publisher pathEDT, ros::
             // DynamicEDTOctomap DistMap(5.0, costMap3D.tree, costMap3D.start, costMap3D.end, false); // take unknwon region as unoccupied
             // function desription =  DynamicEDTOctomapBase<TREE>::DynamicEDTOctomapBase(float maxdist, TREE* _octree, octomap::point3d bbxMin, octomap::point3d bbxMax, bool treatUnknownAsOccupied)
 
-            DynamicEDTOctomap DistMap(5.0, costMap3D.tree, costMap3D.start, costMap3D.end, false); // take unknwon region as unoccupied
-            DistMap.update();
+            std::shared_ptr<DynamicEDTOctomap> DistMap = std::make_shared<DynamicEDTOctomap>(5.0, costMap3D.tree, costMap3D.start, costMap3D.end, false); // take unknwon region as unoccupied
+            DistMap->update();
 
             octomap::point3d qp(24.23, 0.0, 1.25);
 
             // set this as the costMap in the costMap3D object
-            costMap3D.costMap = &DistMap;
+            costMap3D.costMap = DistMap.get();
+
+            // read-only view of this update shared by the search, the optimizer and the visualizers
+            Map3D::MapSnapshotPtr mapSnapshot = Map3D::MapSnapshot::create(DistMap, costMap3D.shared_tree, costMap3D.start, costMap3D.end);
             // MMD_costmap.EDT_Map = &DistMap;
 
             if (queryPtUpdated)
@@ -249,11 +254,11 @@ void plan(ros::Publisher path, ros::Publisher map, ros::Publisher pathEDT, ros::
 
             // set planning range and pass cost map to planner
             kAstar.init(costMap3D.start, costMap3D.end, currPose);
-            kAstar.setEnvironment(&DistMap, costMap3D.tree, costMap3D.new_tree, costMap3D.start, costMap3D.end);
+            kAstar.setEnvironment(mapSnapshot);
 
             // visualize the EDT Map
 
-            costMap3D.getCostMapMarker(costMap_vis, &DistMap, map);
+            costMap3D.getCostMapMarker(costMap_vis, *mapSnapshot, map);
 
             // auto start =  std::chrono::high_resolution_clock::now();
             // auto start = high_resolution_clock::now();
@@ -349,7 +354,7 @@ void plan(ros::Publisher path, ros::Publisher map, ros::Publisher pathEDT, ros::
 
             if (cTraj.size() > 2)
             {
-                optimalTrajectory = optimizer.optimizeTrajectory(BernsteinTraj, cTraj, execTime, costMap3D, sample_trajectory_pub, plan_dur_pub, path_to_weights);
+                optimalTrajectory = optimizer.optimizeTrajectory(BernsteinTraj, cTraj, execTime, mapSnapshot, sample_trajectory_pub, plan_dur_pub, path_to_weights);
 
                 for (auto i = optimalTrajectory.begin(); i != optimalTrajectory.end(); i++)
                 {
@@ -365,7 +370,7 @@ void plan(ros::Publisher path, ros::Publisher map, ros::Publisher pathEDT, ros::
                     octomap::point3d ptObs;
 
                     float dist;
-                    DistMap.getDistanceAndClosestObstacle(pt_, dist, ptObs);
+                    mapSnapshot->edt()->getDistanceAndClosestObstacle(pt_, dist, ptObs);
                     // pEdt.pose.position.x = ptObs.x();
                     // pEdt.pose.position.y = ptObs.y();
                     // pEdt.pose.position.z = ptObs.z();
@@ -517,6 +522,103 @@ int main(int argc, char **argv)
 
     n.getParam("Planner/path_to_weights", path_to_weights);
 
+    int rng_seed = 0;
+    n.getParam("Planner/rng_seed", rng_seed); // fixed seed makes the sampled costs reproducible, 0 draws a new one every run
+    RandomStreams::set_seed(uint64_t(rng_seed));
+
+    std::string noise_sampling = "random";
+    n.getParam("Planner/noise_sampling", noise_sampling);
+
+    // QMC noise lowers the expected MMD (qmc_noise.h, qmcVariance), the cost keeps the pseudo random draws
+    if (RandomStreams::noise_sampling_from_string(noise_sampling) != RandomStreams::PSEUDO_RANDOM)
+    {
+        std::cout << "Planner/noise_sampling " << noise_sampling << " biases the MMD cost, using random" << std::endl;
+    }
+    optimizer.noise_sampling = RandomStreams::PSEUDO_RANDOM;
+
+    n.getParam("Planner/num_threads", optimizer.num_threads); // CEM rollout workers, 0 uses every core
+    n.getParam("Planner/num_modes", optimizer.num_modes);     // independent CEM distributions from lateral offsets of the A* path, one per worker
+    n.getParam("Planner/mode_offset", optimizer.mode_offset); // [m]
+
+    std::string elite_weighting = "uniform";
+    n.getParam("Planner/elite_weighting", elite_weighting); // "softmax" weighs the elites by exp(-cost / temperature)
+    optimizer.elites.weighting = Optimizer::EliteSelection::weighting_from_string(elite_weighting);
+    n.getParam("Planner/elite_temperature", optimizer.elites.temperature);
+    n.getParam("Planner/min_stddev", optimizer.min_stddev);
+    n.getParam("Planner/use_mmd_lut", optimizer.use_mmd_lut);         // rank rollouts by the tabulated expected MMD instead of the sampled one (off by default)
+    n.getParam("Planner/mmd_table_draws", optimizer.mmd_table_draws); // noise draws averaged into every table entry
+    n.getParam("Planner/cache_elite_costs", optimizer.elite_archive.cache_costs); // carried over elites keep their cost instead of being costed again
+
+    std::string screen_proxy = "lut";
+    n.getParam("Planner/screen_rollouts", optimizer.screening.enabled); // proxy cost for every rollout, the full sampled MMD for the best screen_fraction
+    n.getParam("Planner/screen_fraction", optimizer.screening.fraction);
+    n.getParam("Planner/screen_proxy", screen_proxy); // "lut" or "hinge"
+    optimizer.screening.proxy = Optimizer::RolloutScreening::proxy_from_string(screen_proxy);
+    n.getParam("Planner/screen_audit", optimizer.screening.audit); // full cost for every rollout, for the elite recall statistics only
+    n.getParam("Planner/full_covariance", optimizer.covariance.enabled); // correlated perturbations of the free coefficients
+    n.getParam("Planner/covariance_bandwidth", optimizer.covariance.bandwidth); // -1 full, 0 diagonal
+
+    // early termination of the CEM, every criterion is off by default (see cem_termination.h)
+    n.getParam("Planner/cem_iterations", optimizer.numIterations);
+    n.getParam("Planner/cem_variance_threshold", optimizer.termination.variance_threshold);
+    n.getParam("Planner/cem_relative_improvement", optimizer.termination.relative_improvement);
+    n.getParam("Planner/cem_elite_stability", optimizer.termination.elite_stability);
+    n.getParam("Planner/cem_stall_iterations", optimizer.termination.stall_iterations);
+    n.getParam("Planner/cem_min_iterations", optimizer.termination.min_iterations);
+    n.getParam("Planner/cem_time_budget_ms", optimizer.termination.time_budget_ms); // anytime mode, returns the best trajectory so far
+
+    std::string optimizer_backend = "cem";
+    n.getParam("Planner/optimizer_backend", optimizer_backend); // "cem+lbfgs" polishes the CEM result, "lbfgs" replaces the CEM
+    optimizer.backend = Optimizer::backend_from_string(optimizer_backend);
+    n.getParam("Planner/min_cem_budget_ms", optimizer.min_cem_budget_ms); // smaller cem_time_budget_ms run L-BFGS alone
+    n.getParam("Planner/lbfgs_iterations", optimizer.gradient.max_iterations);
+    n.getParam("Planner/lbfgs_memory", optimizer.gradient.memory);
+    n.getParam("Planner/lbfgs_smoothness_weight", optimizer.gradient.smoothness_weight);
+    n.getParam("Planner/cost_field_resolution", optimizer.gradient.field_resolution); // [m]
+
+    n.getParam("Planner/warm_start", optimizer.warm_start.enabled); // seed each replan with the shifted mean and elites of the previous one
+    n.getParam("Planner/warm_start_blend", optimizer.warm_start.blend);
+    n.getParam("Planner/warm_start_stddev", optimizer.warm_start.stddev);
+    n.getParam("Planner/warm_start_max_offset", optimizer.warm_start.max_offset);
+
+    n.getParam("Planner/adaptive_samples", optimizer.sample_schedule.enabled); // fewer rollouts as the sampling stddev shrinks
+    n.getParam("Planner/num_samples", optimizer.numSampleTrajs);
+    n.getParam("Planner/num_elites", optimizer.topSamples);
+    n.getParam("Planner/min_samples", optimizer.sample_schedule.min_samples);
+    n.getParam("Planner/min_elites", optimizer.sample_schedule.min_elites);
+
+    // every iteration carries 0.2 * num_elites archived rows and needs new rollouts beyond them
+    int min_rollouts = int(0.2 * optimizer.topSamples) + 1;
+
+    if (optimizer.sample_schedule.min_samples < min_rollouts || optimizer.sample_schedule.min_samples > optimizer.numSampleTrajs)
+    {
+        int clamped = std::min(std::max(optimizer.sample_schedule.min_samples, min_rollouts), optimizer.numSampleTrajs);
+
+        std::cout << "Planner/min_samples " << optimizer.sample_schedule.min_samples << " out of [" << min_rollouts << ", "
+                  << optimizer.numSampleTrajs << "], using " << clamped << std::endl;
+        optimizer.sample_schedule.min_samples = clamped;
+    }
+
+    optimizer.sample_schedule.min_elites = std::max(1, optimizer.sample_schedule.min_elites);
+
+    n.getParam("Planner/telemetry_rate", optimizer.telemetry_rate); // [Hz] distance / sample trajectory publishing
+
+    std::string mmd_kernel = "polynomial";
+    n.getParam("Planner/mmd_kernel", mmd_kernel); // "rbf" expects the weight_rbf.csv weights
+    optimizer.mmd_kernel = MMDFunctions::POLYNOMIAL_KERNEL;
+
+    // on the 5 transformed features the Fourier features are slower and less accurate than the exact RBF MMD (MMD_rff.h)
+    if (mmd_kernel == "rff")
+    {
+        std::cout << "Planner/mmd_kernel rff is slower than the exact RBF MMD, using rbf" << std::endl;
+        mmd_kernel = "rbf";
+    }
+
+    if (mmd_kernel == "rbf")
+    {
+        optimizer.mmd_kernel = MMDFunctions::RBF_KERNEL;
+    }
+
     /** Subscribers **/
     ros::Subscriber oct = n.subscribe<octomap_msgs::Octomap>("/octomap_binary", 1, octomap_cb);
     ros::Subscriber pos = n.subscribe<geometry_msgs::PoseStamped>("/mavros/local_position/pose", 10, local_pose_cb);
@@ -532,7 +634,7 @@ int main(int argc, char **argv)
     ros::Publisher sample_trajectory_pub = n.advertise<visualization_msgs::Marker>("/sample_trajectories", 0);
     ros::Publisher A_star_pub = n.advertise<visualization_msgs::MarkerArray>("/A_star", 1);
 
-    ros::Publisher plan_dur_pub = n.advertise<std_msgs::Float64>("/distance_data", 10);
+    ros::Publisher plan_dur_pub = n.advertise<std_msgs::Float64MultiArray>("/distance_data", 10); // sampled distances of the mean trajectory, one array per telemetry drain
 
     /** EDT Subscriber and distance publisher **/
     ros::Subscriber queryPoint = n.subscribe<geometry_msgs::PoseStamped>("/QueryPoint", 1, edt_cb);
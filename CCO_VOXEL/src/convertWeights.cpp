@@ -0,0 +1,35 @@
+/**
+ * Convert CSV MMD weights to the binary format memory mapped by the planner
+ *
+ * usage: rosrun CCO_VOXEL convertWeights weight.csv weight.bin
+ **/
+#include "CCO_VOXEL/MMD_weight_store.h"
+
+#include <iostream>
+
+int main(int argc, char **argv)
+{
+
+    if (argc != 3)
+    {
+        std::cout << "usage: convertWeights <weights.csv> <weights.bin>" << std::endl;
+        return 1;
+    }
+
+    if (!MMDFunctions::WeightStore::convert_csv(argv[1], argv[2]))
+    {
+        return 1;
+    }
+
+    // read the result back through the same validation as the planner
+    std::shared_ptr<const MMDFunctions::WeightStore> store = MMDFunctions::WeightStore::load(argv[2]);
+
+    if (!store)
+    {
+        return 1;
+    }
+
+    std::cout << "Wrote " << store->rows() << "x" << store->cols() << " weights to " << argv[2] << std::endl;
+
+    return 0;
+}
@@ -7,6 +7,7 @@
 #include <random>
 #include <algorithm>
 #include "CCO_VOXEL/MMD_map.h"
+#include "CCO_VOXEL/qmc_noise.h"
 using namespace std;
 using namespace Eigen;
 
@@ -78,10 +79,6 @@ namespace fast_planner
     const int tolerance = ceil(1 / resolution_);
 
     int num_samples_of_distance_distribution = 100;
-    std::random_device rd{};
-    std::mt19937 gen{rd()};
-
-    std::normal_distribution<> noise{0, 2};
     Eigen::MatrixXf noise_distribution(1, num_samples_of_distance_distribution);
     Eigen::MatrixXf noise_distribution2(1, num_samples_of_distance_distribution);
     Eigen::MatrixXf radius(1, num_samples_of_distance_distribution);
@@ -94,34 +91,59 @@ namespace fast_planner
     bool trigger_convergence = false;
     float goal_radius = 3.0;
 
-    using normal_dist = std::normal_distribution<>;
-    using discrete_dist = std::discrete_distribution<std::size_t>;
-
-    auto G = std::array<normal_dist, 4>{
-        normal_dist{0, 1},    // mean, stddev of G[0]
-        normal_dist{0, 0.75}, // mean, stddev of G[1]
-        normal_dist{0, 1.75}, // mean, stddev of G[2]
-        normal_dist{0, 2.25}  // mean, stddev of G[3]
+    // Gaussian mixture, equal weights
+    const float G[4] = {
+        1,    // stddev of G[0]
+        0.75, // stddev of G[1]
+        1.75, // stddev of G[2]
+        2.25  // stddev of G[3]
     };
 
-    auto w = discrete_dist{
-        0.25, // weight of G[0]
-        0.25, // weight of G[1]
-        0.25, // weight of G[2]
-        0.25  // weight of G[2]
-    };
+    Eigen::RowVectorXf mixture_choice(num_samples_of_distance_distribution);
+    Eigen::RowVectorXf standard_noise(num_samples_of_distance_distribution);
+
+    // one noise draw per map version, so every search on the snapshot shares the table below
+    uint32_t epoch = uint32_t(map_->version());
+
+    RandomStreams::Stream(RandomStreams::ASTAR_NOISE, epoch, 0).fill_uniform(mixture_choice.data(), num_samples_of_distance_distribution);
+    RandomStreams::fill_noise(noise_sampling_, RandomStreams::Stream(RandomStreams::ASTAR_NOISE, epoch, 1), standard_noise.data(), num_samples_of_distance_distribution, 0.0, 1.0);
+
+    Eigen::RowVectorXf mixture_noise(num_samples_of_distance_distribution);
 
     for (int i = 0; i < num_samples_of_distance_distribution; i++)
     {
+      // QMC: every component takes an equal share of the (shuffled) points, the shuffle below
+      // gives every sample position the mixture marginal again
+      int index = (noise_sampling_ == RandomStreams::PSEUDO_RANDOM) ? std::min(int(mixture_choice(i) * 4), 3) : i % 4;
+      mixture_noise(i) = G[index] * standard_noise(i);
+    }
+
+    if (noise_sampling_ != RandomStreams::PSEUDO_RANDOM)
+    {
+      RandomStreams::shuffle(RandomStreams::Stream(RandomStreams::ASTAR_NOISE, epoch, 2), mixture_noise.data(), num_samples_of_distance_distribution);
+    }
 
-      auto index = w(gen);
-      auto temp_noise_val = G[index](gen);
-      // float temp_noise_val = float(noise(gen));
-      noise_distribution(0, i) = radius(0, i) - temp_noise_val;
-      noise_distribution2(0, i) = temp_noise_val;
+    for (int i = 0; i < num_samples_of_distance_distribution; i++)
+    {
+      noise_distribution(0, i) = radius(0, i) - mixture_noise(i);
+      noise_distribution2(0, i) = mixture_noise(i);
     }
 
     float mmd_threshold_value = determine_mmd_threshold_value(noise_distribution2, num_samples_of_distance_distribution);
+
+    if (use_mmd_lut_)
+    {
+      // the noise is fixed for the whole search, so the edge MMD only depends on the EDT distance
+      mmd_table_ = map_->derived<MMDFunctions::MMD_lookup_table>("astar mmd table " + path_to_weights + " sampling " + std::to_string(int(noise_sampling_)), [&]()
+                                                                 {
+        std::shared_ptr<MMDFunctions::MMD_lookup_table> table = std::make_shared<MMDFunctions::MMD_lookup_table>();
+        table->build([&](const Eigen::VectorXf &distances, Eigen::VectorXf &mmd_values)
+                     {
+                       Eigen::MatrixXf distributions = (noise_distribution.replicate(distances.size(), 1).colwise() - distances).cwiseMax(0.0f);
+                       MMDF.MMD_transformed_features_batch(distributions, mmd_values);
+                     });
+        return table; });
+    }
     bool begin_goal_inversion = false;
 
     /* ---------- search loop ---------- */
@@ -267,6 +289,11 @@ namespace fast_planner
 
       OctoEDT->getDistanceAndClosestObstacle(state_pos_start, distance_val_start, closestObstacle_per_point);
 
+      bool trigger_convergence = sqrt((cur_state.head(3) - end_state.head(3)).norm()) <= goal_radius;
+
+      // edges that pass the feasibility checks, costed together once every input has been propagated
+      vector<EdgeCandidate> candidates;
+
       for (int i = 0; i < inputs.size(); ++i)
         for (int j = 0; j < durations.size(); ++j)
         {
@@ -406,7 +433,6 @@ namespace fast_planner
                     continue;
                   }
           */
-          bool trigger_convergence = sqrt((cur_state.head(3) - end_state.head(3)).norm()) <= goal_radius;
 
           Eigen::Vector3d pos;
           Eigen::Matrix<double, 6, 1> xt;
@@ -473,146 +499,175 @@ namespace fast_planner
             continue;
           }
 
-          // if( pro_state(2) > 4){
-          //   break;
-          // }
-
-          float MMD_start, MMD_end, delta_MMD, distance_val_end;
+          EdgeCandidate candidate;
+          candidate.input = um;
+          candidate.tau = tau;
+          candidate.state = pro_state;
+          candidate.index = pro_id;
+          candidate.time_idx = pro_t_id;
+          candidate.delta_MMD = 0;
 
           if (!trigger_convergence)
           {
-
-            // octomap::point3d closestObstacle_per_point;
-
             octomap::point3d state_pos_end;
-            // octomap::point3d state_pos_end;
-            // state_pos_start.x() = cur_state(0);
-            // state_pos_start.y() = cur_state(1);
-            // state_pos_start.z() = cur_state(2);
 
             state_pos_end.x() = pro_state(0);
             state_pos_end.y() = pro_state(1);
             state_pos_end.z() = pro_state(2);
 
-            // OctoEDT->getDistanceAndClosestObstacle(state_pos_start,distance_val_start, closestObstacle_per_point);
-            OctoEDT->getDistanceAndClosestObstacle(state_pos_end, distance_val_end, closestObstacle_per_point);
+            OctoEDT->getDistanceAndClosestObstacle(state_pos_end, candidate.distance_end, closestObstacle_per_point);
+          }
 
-            if (distance_val_start < 2.0)
-            {
+          candidates.push_back(candidate);
+        }
 
-              actual_distance = Eigen::MatrixXf::Constant(1, num_samples_of_distance_distribution, distance_val_start);
-              actual_distribution = zero_matrix.cwiseMax(noise_distribution - actual_distance);
-              MMD_start = MMDF.MMD_transformed_features(actual_distribution);
-              // MMD_start +=  0.1*MMD_start*float(cur_state(2)) ;
-            }
-            else
-            {
-              MMD_start = 0;
-            }
-            if (distance_val_end < 2.0)
-            {
-              actual_distance = Eigen::MatrixXf::Constant(1, num_samples_of_distance_distribution, distance_val_end);
-              actual_distribution = zero_matrix.cwiseMax(noise_distribution - actual_distance);
-              MMD_end = MMDF.MMD_transformed_features(actual_distribution); //+ 3*float(pro_state(2)) ;
-              // MMD_end += 0.1*MMD_end*float(pro_state(2)) ;
-            }
-            else
-            {
-              MMD_end = 0;
-            }
-            delta_MMD = MMD_end - MMD_start;
-          }
+      /* ---------- MMD cost of all candidate edges in one batch ---------- */
 
-          if (trigger_convergence)
+      if (!trigger_convergence && !candidates.empty())
+      {
+        float MMD_start = 0;
+
+        if (distance_val_start < 2.0)
+        {
+          if (use_mmd_lut_)
           {
+            MMD_start = mmd_table_->lookup(distance_val_start);
+          }
+          else
+          {
+            actual_distance = Eigen::MatrixXf::Constant(1, num_samples_of_distance_distribution, distance_val_start);
+            actual_distribution = zero_matrix.cwiseMax(noise_distribution - actual_distance);
+            MMD_start = MMDF.MMD_transformed_features(actual_distribution);
+          }
+        }
+
+        std::vector<int> near_obstacle;
+        for (int c = 0; c < candidates.size(); ++c)
+        {
+          if (candidates[c].distance_end < 2.0)
+            near_obstacle.push_back(c);
+        }
 
-            delta_MMD = 0;
+        Eigen::VectorXf MMD_end(near_obstacle.size());
 
-            // std::cout << " Triggered trigger_convergence  /////////////////**************************////////////////// " << std::endl;
-            //  std::cout << " ******************************* /////////////////**************************////////////////// " << std::endl;
+        if (use_mmd_lut_)
+        {
+          for (int r = 0; r < near_obstacle.size(); ++r)
+          {
+            MMD_end(r) = mmd_table_->lookup(candidates[near_obstacle[r]].distance_end);
+          }
+        }
+        else
+        {
+          Eigen::MatrixXf end_distributions(near_obstacle.size(), num_samples_of_distance_distribution);
+          for (int r = 0; r < near_obstacle.size(); ++r)
+          {
+            end_distributions.row(r) = (noise_distribution.array() - candidates[near_obstacle[r]].distance_end).max(0.0f);
           }
 
-          /* ---------- compute cost ---------- */
-          double time_to_goal, tmp_g_score, tmp_f_score;
-          tmp_g_score = (um.squaredNorm() + w_time_) * tau + cur_node->g_score + delta_MMD;
-          tmp_f_score = tmp_g_score + lambda_heu_ * estimateHeuristic(pro_state, end_state, time_to_goal);
-          // tmp_f_score = tmp_g_score  + lambda_heu_ * estimateHeuristic(pro_state, end_state, time_to_goal);
-          time_to_desination = time_to_goal;
+          MMDF.MMD_transformed_features_batch(end_distributions, MMD_end);
+        }
 
-          /* ---------- compare expanded node in this loop ---------- */
+        for (int c = 0; c < candidates.size(); ++c)
+        {
+          candidates[c].delta_MMD = -MMD_start;
+        }
+        for (int r = 0; r < near_obstacle.size(); ++r)
+        {
+          candidates[near_obstacle[r]].delta_MMD += MMD_end(r);
+        }
+      }
 
-          bool prune = false;
-          for (int j = 0; j < tmp_expand_nodes.size(); ++j)
+      for (int c = 0; c < candidates.size(); ++c)
+      {
+        um = candidates[c].input;
+        double tau = candidates[c].tau;
+        pro_state = candidates[c].state;
+        Eigen::Vector3i pro_id = candidates[c].index;
+        int pro_t_id = candidates[c].time_idx;
+        float delta_MMD = candidates[c].delta_MMD;
+
+        PathNodePtr pro_node = expanded_nodes_.find(pro_id);
+
+        /* ---------- compute cost ---------- */
+        double time_to_goal, tmp_g_score, tmp_f_score;
+        tmp_g_score = (um.squaredNorm() + w_time_) * tau + cur_node->g_score + delta_MMD;
+        tmp_f_score = tmp_g_score + lambda_heu_ * estimateHeuristic(pro_state, end_state, time_to_goal);
+        // tmp_f_score = tmp_g_score  + lambda_heu_ * estimateHeuristic(pro_state, end_state, time_to_goal);
+        time_to_desination = time_to_goal;
+
+        /* ---------- compare expanded node in this loop ---------- */
+
+        bool prune = false;
+        for (int j = 0; j < tmp_expand_nodes.size(); ++j)
+        {
+          PathNodePtr expand_node = tmp_expand_nodes[j];
+          if ((pro_id - expand_node->index).norm() == 0 &&
+              ((!dynamic) || pro_t_id == expand_node->time_idx))
           {
-            PathNodePtr expand_node = tmp_expand_nodes[j];
-            if ((pro_id - expand_node->index).norm() == 0 &&
-                ((!dynamic) || pro_t_id == expand_node->time_idx))
-            {
 
-              prune = true;
+            prune = true;
 
-              if (tmp_f_score < expand_node->f_score)
-              {
-                expand_node->f_score = tmp_f_score;
-                expand_node->g_score = tmp_g_score;
-                expand_node->state = pro_state;
-                expand_node->input = um;
-                expand_node->duration = tau;
-              }
-              break;
+            if (tmp_f_score < expand_node->f_score)
+            {
+              expand_node->f_score = tmp_f_score;
+              expand_node->g_score = tmp_g_score;
+              expand_node->state = pro_state;
+              expand_node->input = um;
+              expand_node->duration = tau;
             }
+            break;
           }
+        }
 
-          /* ---------- new neighbor in this loop ---------- */
+        /* ---------- new neighbor in this loop ---------- */
 
-          if (!prune)
+        if (!prune)
+        {
+          if (pro_node == NULL)
           {
-            if (pro_node == NULL)
-            {
-              pro_node = path_node_pool_[use_node_num_];
-              pro_node->index = pro_id;
-              pro_node->state = pro_state;
-              pro_node->f_score = tmp_f_score;
-              pro_node->g_score = tmp_g_score;
-              pro_node->input = um;
-              pro_node->duration = tau;
-              pro_node->parent = cur_node;
-              pro_node->node_state = IN_OPEN_SET;
+            pro_node = path_node_pool_[use_node_num_];
+            pro_node->index = pro_id;
+            pro_node->state = pro_state;
+            pro_node->f_score = tmp_f_score;
+            pro_node->g_score = tmp_g_score;
+            pro_node->input = um;
+            pro_node->duration = tau;
+            pro_node->parent = cur_node;
+            pro_node->node_state = IN_OPEN_SET;
 
-              open_set_.push(pro_node);
+            open_set_.push(pro_node);
 
-              expanded_nodes_.insert(pro_id, pro_node);
+            expanded_nodes_.insert(pro_id, pro_node);
 
-              tmp_expand_nodes.push_back(pro_node);
+            tmp_expand_nodes.push_back(pro_node);
 
-              use_node_num_ += 1;
-              if (use_node_num_ == allocate_num_)
-              {
-                cout << "run out of memory." << endl;
-                return NO_PATH;
-              }
-            }
-            else if (pro_node->node_state == IN_OPEN_SET)
+            use_node_num_ += 1;
+            if (use_node_num_ == allocate_num_)
             {
-              if (tmp_g_score < pro_node->g_score)
-              {
-                // pro_node->index = pro_id;
-                pro_node->state = pro_state;
-                pro_node->f_score = tmp_f_score;
-                pro_node->g_score = tmp_g_score;
-                pro_node->input = um;
-                pro_node->duration = tau;
-                pro_node->parent = cur_node;
-              }
+              cout << "run out of memory." << endl;
+              return NO_PATH;
             }
-            else
+          }
+          else if (pro_node->node_state == IN_OPEN_SET)
+          {
+            if (tmp_g_score < pro_node->g_score)
             {
-              cout << "error type in searching: " << pro_node->node_state << endl;
+              // pro_node->index = pro_id;
+              pro_node->state = pro_state;
+              pro_node->f_score = tmp_f_score;
+              pro_node->g_score = tmp_g_score;
+              pro_node->input = um;
+              pro_node->duration = tau;
+              pro_node->parent = cur_node;
             }
           }
-
-          /* ----------  ---------- */
+          else
+          {
+            cout << "error type in searching: " << pro_node->node_state << endl;
+          }
         }
+      }
     }
 
     /* ---------- open set empty, no path ---------- */
@@ -636,6 +691,18 @@ namespace fast_planner
     nh.param("search/margin", margin_, 1.00);
     nh.param("search/allocate_num", allocate_num_, 100000);
     nh.param("search/check_num", check_num_, 5);
+    nh.param("search/use_mmd_lut", use_mmd_lut_, true);
+
+    std::string noise_sampling;
+    nh.param("search/noise_sampling", noise_sampling, std::string("random"));
+
+    // QMC noise lowers the expected MMD (qmc_noise.h, qmcVariance), the search keeps the pseudo random draws
+    if (RandomStreams::noise_sampling_from_string(noise_sampling) != RandomStreams::PSEUDO_RANDOM)
+    {
+      std::cout << "search/noise_sampling " << noise_sampling << " biases the MMD cost, using random" << std::endl;
+    }
+    noise_sampling_ = RandomStreams::PSEUDO_RANDOM;
+    MMD_costmap.noise_sampling = noise_sampling_;
 
     cout << "margin:" << margin_ << endl;
     cout << "allocate num:" << allocate_num_ << endl;
@@ -920,13 +987,16 @@ namespace fast_planner
     iter_num_ = 0;
   }
 
-  void fast_planner::KinodynamicAstar::setEnvironment(DynamicEDTOctomap *env_ptr, octomap::OcTree *octomap_tree, octomap::AbstractOcTree *abstract_tree, octomap::point3d map_start_pt, octomap::point3d map_end_pt)
+  void fast_planner::KinodynamicAstar::setEnvironment(const Map3D::MapSnapshotPtr &map)
   {
 
-    this->OctoEDT = env_ptr;
+    this->map_ = map;
+    this->OctoEDT = map->edt();
+
+    this->octomap_tree = map->tree();
 
-    this->octomap_tree = octomap_tree;
-    this->abstract_tree = abstract_tree;
+    octomap::point3d map_start_pt = map->start();
+    octomap::point3d map_end_pt = map->end();
 
     MMD_costmap.octree_for_mmd = octomap_tree;
 
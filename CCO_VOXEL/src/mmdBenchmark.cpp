@@ -0,0 +1,363 @@
+/**
+ * Speed and accuracy benchmark of the MMD variants
+ *
+ * usage: rosrun CCO_VOXEL mmdBenchmark weight.csv [weight_rbf.csv] [results.csv]
+ *
+ * Sweeps the EDT distance, the number of samples of the distance distribution and the noise
+ * model the distributions are drawn with:
+ *   cem    max(0, safeRadius - dist - z),   z ~ N(0, 1), safeRadius = 1     (CrossEntropyOptimizer)
+ *   astar  max(0, 0.75 - dist - z),         z ~ equal mixture of N(0, {1, 0.75, 1.75, 2.25}^2)  (KinodynamicAstar)
+ *   map    max(0, 0.75 - dist - z),         z ~ N(0, 2^2)                   (MMD_Map_Functions)
+ * and writes one CSV row per (variant, noise model, samples, distance) with
+ *   ns_per_eval      wall time of one evaluation, the batch variant is divided by its rows
+ *   allocs_per_eval  heap allocations per evaluation (glibc only, 0 elsewhere)
+ *   mean_value / mean_reference   averaged over the replicates
+ *   mean_abs_error / max_abs_error / mean_rel_error   against the exact reference of the same samples
+ * The exact reference is the N x N kernel sum of the original implementation in double:
+ * the polynomial kernel for vectorized, transformed, transformed_batch, interpolation and lut,
+ * the RBF kernel for transformed_rbf, rbf and rff. Relative errors are taken against
+ * max(|reference|, 1) since the RBF MMD goes to 0 away from obstacles.
+ *
+ * Variants on the transformed features (and the distance only ones tuned on them) need the
+ * 100 samples the weights were trained for and are only reported at samples = 100.
+ * The CSV goes to results.csv, or to stdout if no path is given.
+ **/
+#include "CCO_VOXEL/MMD_kernels.h"
+#include "CCO_VOXEL/MMD_lookup_table.h"
+#include "CCO_VOXEL/MMD_moments.h"
+#include "CCO_VOXEL/MMD_rff.h"
+#include "CCO_VOXEL/philox_rng.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Every heap allocation of the process, Eigen included, ends in malloc / calloc / realloc:
+ * they are interposed here and forwarded to the glibc implementation
+ **/
+static std::atomic<long> allocation_count{0};
+
+#ifdef __GLIBC__
+extern "C"
+{
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t count, size_t size);
+    void *__libc_realloc(void *ptr, size_t size);
+
+    void *malloc(size_t size)
+    {
+        allocation_count.fetch_add(1, std::memory_order_relaxed);
+        return __libc_malloc(size);
+    }
+
+    void *calloc(size_t count, size_t size)
+    {
+        allocation_count.fetch_add(1, std::memory_order_relaxed);
+        return __libc_calloc(count, size);
+    }
+
+    void *realloc(void *ptr, size_t size)
+    {
+        allocation_count.fetch_add(1, std::memory_order_relaxed);
+        return __libc_realloc(ptr, size);
+    }
+}
+#endif
+
+static const int NUM_REPLICATES = 64;
+static const double MIN_SECONDS_PER_CASE = 0.01;
+
+enum NoiseModel
+{
+    CEM_NOISE,
+    ASTAR_NOISE,
+    MAP_NOISE
+};
+
+static const char *noise_model_names[3] = {"cem", "astar", "map"};
+
+/** one replicate of the noise of a model, the distribution at dist is max(0, noise - dist) **/
+static Eigen::RowVectorXf draw_noise(NoiseModel model, uint32_t replicate, int n)
+{
+    Eigen::RowVectorXf noise(n);
+
+    if (model == CEM_NOISE)
+    {
+        RandomStreams::Stream(RandomStreams::CEM_COLLISION, replicate).fill_normal(noise.data(), n, 0.0, 1.0);
+        return 1.0f - noise.array();
+    }
+
+    if (model == ASTAR_NOISE)
+    {
+        const float G[4] = {1, 0.75, 1.75, 2.25};
+        Eigen::RowVectorXf mixture_choice(n);
+
+        RandomStreams::Stream(RandomStreams::ASTAR_NOISE, replicate, 0).fill_uniform(mixture_choice.data(), n);
+        RandomStreams::Stream(RandomStreams::ASTAR_NOISE, replicate, 1).fill_normal(noise.data(), n, 0.0, 1.0);
+
+        for (int i = 0; i < n; i++)
+        {
+            noise(i) = 0.75f - G[std::min(int(mixture_choice(i) * 4), 3)] * noise(i);
+        }
+        return noise;
+    }
+
+    RandomStreams::Stream(RandomStreams::MAP_NOISE, replicate).fill_normal(noise.data(), n, 0.0, 2.0);
+    return 0.75f - noise.array();
+}
+
+/** N x N polynomial kernel sum with the cross and ideal terms kept as N, as MMD_vectorized had it **/
+static double exact_polynomial_MMD(const Eigen::VectorXd &x)
+{
+    double n = double(x.size());
+    double kernel_sum = 0;
+
+    for (int i = 0; i < x.size(); i++)
+        for (int j = 0; j < x.size(); j++)
+            kernel_sum += (1 + x(i) * x(j)) * (1 + x(i) * x(j));
+
+    return kernel_sum - 2 * n + n;
+}
+
+static double exact_rbf_MMD(const Eigen::VectorXd &x)
+{
+    double n = double(x.size());
+    double gamma = -1.0 / (2.0 * double(MMDFunctions::RBF_BANDWIDTH) * double(MMDFunctions::RBF_BANDWIDTH));
+    double kernel_sum = 0, zero_sum = 0;
+
+    for (int i = 0; i < x.size(); i++)
+    {
+        for (int j = 0; j < x.size(); j++)
+            kernel_sum += std::exp(gamma * (x(i) - x(j)) * (x(i) - x(j)));
+
+        zero_sum += std::exp(gamma * x(i) * x(i));
+    }
+
+    return kernel_sum - 2 * n * zero_sum + n * n;
+}
+
+/** the replicates of one (noise model, samples, distance) case, one distribution per row **/
+struct BenchmarkCase
+{
+    NoiseModel model;
+    int num_samples;
+    float distance;
+    Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> samples; // contiguous rows for the per distribution variants
+    Eigen::MatrixXf distributions;                                                 // same values, the layout of the batch calls
+};
+
+struct Variant
+{
+    std::string name;
+    bool needs_transformed; // only defined for the 100 samples of the weights
+    std::function<double(const Eigen::VectorXd &)> reference;
+    std::function<float(const BenchmarkCase &, int)> evaluate;                    // replicate r of the case
+    std::function<void(const BenchmarkCase &, Eigen::VectorXf &)> evaluate_batch; // all the replicates at once, optional
+};
+
+static void run_variant(const Variant &variant, const BenchmarkCase &bench_case, const std::vector<double> &reference, FILE *csv)
+{
+    int rows = int(bench_case.samples.rows());
+    Eigen::VectorXf values(rows);
+
+    // warm up (and first use allocations of the shared state) outside of the measurement
+    if (variant.evaluate_batch)
+        variant.evaluate_batch(bench_case, values);
+    else
+        for (int r = 0; r < rows; r++)
+            values(r) = variant.evaluate(bench_case, r);
+
+    long evaluations = 0;
+    long allocations_before = allocation_count.load();
+    volatile float sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+
+    while (elapsed < MIN_SECONDS_PER_CASE)
+    {
+        if (variant.evaluate_batch)
+        {
+            variant.evaluate_batch(bench_case, values);
+            sink = sink + values(0);
+        }
+        else
+        {
+            for (int r = 0; r < rows; r++)
+                sink = sink + variant.evaluate(bench_case, r);
+        }
+
+        evaluations += rows;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    double allocs_per_eval = double(allocation_count.load() - allocations_before) / double(evaluations);
+    double ns_per_eval = 1e9 * elapsed / double(evaluations);
+
+    double mean_value = 0, mean_reference = 0, mean_abs_error = 0, max_abs_error = 0, mean_rel_error = 0;
+
+    for (int r = 0; r < rows; r++)
+    {
+        double error = std::abs(double(values(r)) - reference[r]);
+
+        mean_value += values(r) / rows;
+        mean_reference += reference[r] / rows;
+        mean_abs_error += error / rows;
+        max_abs_error = std::max(max_abs_error, error);
+        mean_rel_error += error / std::max(std::abs(reference[r]), 1.0) / rows;
+    }
+
+    fprintf(csv, "%s,%s,%d,%.3f,%.1f,%.3f,%.6g,%.6g,%.6g,%.6g,%.6g\n", variant.name.c_str(), noise_model_names[bench_case.model],
+            bench_case.num_samples, bench_case.distance, ns_per_eval, allocs_per_eval, mean_value, mean_reference,
+            mean_abs_error, max_abs_error, mean_rel_error);
+}
+
+int main(int argc, char **argv)
+{
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s weight.csv [weight_rbf.csv] [results.csv]\n", argv[0]);
+        return 1;
+    }
+
+    RandomStreams::set_seed(1);
+
+    MMDFunctions::WeightMatrix weights, rbf_weights;
+
+    if (!MMDFunctions::load_weights(argv[1], weights))
+        return 1;
+
+    bool have_rbf_weights = argc > 2 && MMDFunctions::load_weights(argv[2], rbf_weights);
+
+    FILE *csv = stdout;
+
+    if (argc > 3 && !(csv = fopen(argv[3], "w")))
+    {
+        fprintf(stderr, "cannot write %s\n", argv[3]);
+        return 1;
+    }
+
+    Eigen::MatrixXd weights_d = weights.cast<double>();
+    Eigen::MatrixXd rbf_weights_d = rbf_weights.cast<double>();
+
+    std::shared_ptr<const MMDFunctions::RandomFourierFeatures> rff = MMDFunctions::RandomFourierFeatures::shared();
+
+    // distance only variants are tabulated / fitted on one fixed draw of the noise, as the planner does
+    MMDFunctions::MMD_lookup_table lut[3];
+
+    for (int model = 0; model < 3; model++)
+    {
+        Eigen::RowVectorXf noise = draw_noise(NoiseModel(model), 1000000, MMDFunctions::NUM_DISTRIBUTION_SAMPLES);
+
+        lut[model].build([&](const Eigen::VectorXf &distances, Eigen::VectorXf &mmd_values)
+                         {
+                             Eigen::MatrixXf distributions = (noise.replicate(distances.size(), 1).colwise() - distances).cwiseMax(0.0f);
+                             MMDFunctions::transformed_MMD_batch(distributions, weights, mmd_values);
+                         },
+                         0.0, 2.75, 276);
+    }
+
+    auto polynomial_features = [&](const Eigen::VectorXd &x) -> double
+    { return exact_polynomial_MMD(weights_d.transpose() * x); };
+
+    std::vector<Variant> variants;
+
+    variants.push_back({"vectorized", false, exact_polynomial_MMD,
+                        [](const BenchmarkCase &c, int r)
+                        { return MMDFunctions::polynomial_MMD(c.samples.row(r)); },
+                        nullptr});
+    variants.push_back({"transformed", true, polynomial_features,
+                        [&](const BenchmarkCase &c, int r)
+                        { return MMDFunctions::transformed_MMD(c.samples.row(r), weights); },
+                        nullptr});
+    variants.push_back({"transformed_batch", true, polynomial_features, nullptr,
+                        [&](const BenchmarkCase &c, Eigen::VectorXf &values)
+                        { MMDFunctions::transformed_MMD_batch(c.distributions, weights, values); }});
+
+    MMDFunctions::MMDBatchScratch batch_scratch; // reused across calls, as the optimizer's workers do
+
+    variants.push_back({"transformed_scratch", true, polynomial_features, nullptr,
+                        [&](const BenchmarkCase &c, Eigen::VectorXf &values)
+                        {
+                            MMDFunctions::transformed_MMD_batch(c.distributions, weights, batch_scratch);
+                            values.head(c.distributions.rows()) = batch_scratch.values.head(c.distributions.rows());
+                        }});
+
+    if (have_rbf_weights)
+    {
+        variants.push_back({"transformed_rbf", true,
+                            [&](const Eigen::VectorXd &x)
+                            { return exact_rbf_MMD(rbf_weights_d.transpose() * x); },
+                            [&](const BenchmarkCase &c, int r)
+                            { return MMDFunctions::transformed_MMD(c.samples.row(r), rbf_weights, MMDFunctions::RBF_KERNEL); },
+                            nullptr});
+    }
+
+    variants.push_back({"rbf", false, exact_rbf_MMD,
+                        [](const BenchmarkCase &c, int r)
+                        { return MMDFunctions::rbf_MMD(c.samples.row(r).data(), c.num_samples); },
+                        nullptr});
+    variants.push_back({"rff", false, exact_rbf_MMD,
+                        [&](const BenchmarkCase &c, int r)
+                        { return rff->MMD(c.samples.row(r).data(), c.num_samples); },
+                        nullptr});
+    variants.push_back({"interpolation", true, polynomial_features,
+                        [](const BenchmarkCase &c, int)
+                        { return MMDFunctions::interpolated_MMD(c.distance); },
+                        nullptr});
+    variants.push_back({"lut", true, polynomial_features,
+                        [&](const BenchmarkCase &c, int)
+                        { return lut[c.model].lookup(c.distance); },
+                        nullptr});
+
+    fprintf(stderr, "rbf_MMD: %s, rff dimension %d\n", MMDFunctions::rbf_simd_level(), rff->dimension());
+    fprintf(csv, "variant,noise_model,samples,distance,ns_per_eval,allocs_per_eval,mean_value,mean_reference,mean_abs_error,max_abs_error,mean_rel_error\n");
+
+    for (int model = 0; model < 3; model++)
+    {
+        for (int num_samples : {10, 32, 100})
+        {
+            for (int k = 0; k <= 11; k++)
+            {
+                BenchmarkCase bench_case;
+                bench_case.model = NoiseModel(model);
+                bench_case.num_samples = num_samples;
+                bench_case.distance = 0.25f * k;
+                bench_case.samples.resize(NUM_REPLICATES, num_samples);
+
+                for (int r = 0; r < NUM_REPLICATES; r++)
+                {
+                    bench_case.samples.row(r) = (draw_noise(bench_case.model, r, num_samples).array() - bench_case.distance).max(0.0f);
+                }
+                bench_case.distributions = bench_case.samples;
+
+                for (const Variant &variant : variants)
+                {
+                    if (variant.needs_transformed && num_samples != MMDFunctions::NUM_DISTRIBUTION_SAMPLES)
+                        continue;
+
+                    std::vector<double> reference(NUM_REPLICATES);
+
+                    for (int r = 0; r < NUM_REPLICATES; r++)
+                    {
+                        reference[r] = variant.reference(bench_case.samples.row(r).transpose().cast<double>());
+                    }
+
+                    run_variant(variant, bench_case, reference, csv);
+                }
+            }
+        }
+    }
+
+    if (csv != stdout)
+        fclose(csv);
+
+    return 0;
+}
@@ -51,8 +51,7 @@ visualization_msgs::MarkerArray costMap_vis;
 /** octomap callback **/
 void octomap_cb(const octomap_msgs::Octomap octo)
 {
-    costMap3D.new_tree = octomap_msgs::binaryMsgToMap(octo); // this is the abstract tree for an octomap
-    costMap3D.tree = dynamic_cast<octomap::OcTree *>(costMap3D.new_tree);
+    costMap3D.setTree(octomap_msgs::binaryMsgToMap(octo)); // this is the abstract tree for an octomap, converted to an OcTree
 
     // get the min and max of the map
     costMap3D.setMinMax();
@@ -138,15 +137,17 @@ void plan(ros::Publisher path, ros::Publisher map)
             std::cout << "Updating the map from ... " << costMap3D.start << " to" << costMap3D.end << std::endl;
 
             // calculate EDT now
-            DynamicEDTOctomap DistMap(5.0, costMap3D.tree, costMap3D.start, costMap3D.end, false); // take unknwon region as unoccupied
-            DistMap.update();
+            std::shared_ptr<DynamicEDTOctomap> DistMap = std::make_shared<DynamicEDTOctomap>(5.0, costMap3D.tree, costMap3D.start, costMap3D.end, false); // take unknwon region as unoccupied
+            DistMap->update();
+
+            Map3D::MapSnapshotPtr mapSnapshot = Map3D::MapSnapshot::create(DistMap, costMap3D.shared_tree, costMap3D.start, costMap3D.end);
 
             // set planning range and pass cost map to planner
             kAstar.init(costMap3D.start, costMap3D.end, currPose);
-            kAstar.setEnvironment(&DistMap);
+            kAstar.setEnvironment(mapSnapshot);
 
             // publish the EDT Map
-            costMap3D.getCostMapMarker(costMap_vis, &DistMap, map);
+            costMap3D.getCostMapMarker(costMap_vis, *mapSnapshot, map);
 
             // run the planner now
             int status;
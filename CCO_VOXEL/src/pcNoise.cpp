@@ -7,11 +7,13 @@
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
 #include <pcl/filters/voxel_grid.h>
-#include <random> // for random no. generation
+#include "CCO_VOXEL/philox_rng.h" // for random no. generation
+#include <vector>
 
 ros::Publisher pub;
 
 float var;
+uint32_t cloud_count = 0; // epoch of the noise stream, every cloud gets new noise
 
 void cloud_cb(const sensor_msgs::PointCloud2ConstPtr &cloud_msg)
 {
@@ -26,17 +28,18 @@ void cloud_cb(const sensor_msgs::PointCloud2ConstPtr &cloud_msg)
   xyz_cloud_filtered->width = xyz_cloud->width;
   xyz_cloud_filtered->height = xyz_cloud->height;
 
-  std::default_random_engine generator;
-  std::normal_distribution<double> distribution(0.0, var); // mean and standard deviation
+  // x, y, z noise of every point, mean and standard deviation
+  std::vector<float> noise(3 * xyz_cloud->points.size());
+  RandomStreams::Stream(RandomStreams::POINTCLOUD_NOISE, cloud_count++).fill_normal(noise.data(), int(noise.size()), 0.0, var);
 
   for (size_t points_i = 0; points_i < xyz_cloud->points.size(); ++points_i)
   {
     if ((xyz_cloud->points[points_i].z < 4))
     {
 
-      xyz_cloud_filtered->points[points_i].x = xyz_cloud->points[points_i].x + static_cast<float>(distribution(generator));
-      xyz_cloud_filtered->points[points_i].y = xyz_cloud->points[points_i].y + static_cast<float>(distribution(generator));
-      xyz_cloud_filtered->points[points_i].z = xyz_cloud->points[points_i].z + static_cast<float>(distribution(generator));
+      xyz_cloud_filtered->points[points_i].x = xyz_cloud->points[points_i].x + noise[3 * points_i];
+      xyz_cloud_filtered->points[points_i].y = xyz_cloud->points[points_i].y + noise[3 * points_i + 1];
+      xyz_cloud_filtered->points[points_i].z = xyz_cloud->points[points_i].z + noise[3 * points_i + 2];
     }
   }
 
@@ -52,6 +55,10 @@ int main(int argc, char **argv)
   ros::init(argc, argv, "pcl_basics");
   ros::NodeHandle nh;
   nh.getParam("pcNoise/noise", var);
+
+  int seed = 0;
+  nh.getParam("pcNoise/seed", seed); // 0 draws a new seed every run
+  RandomStreams::set_seed(uint64_t(seed));
   ros::Subscriber sub = nh.subscribe<sensor_msgs::PointCloud2>("/camera/depth/points", 1, cloud_cb);
   pub = nh.advertise<sensor_msgs::PointCloud2>("output", 1);
   ros::spin();
@@ -0,0 +1,292 @@
+/**
+ * Variance matching harness for the QMC noise samples
+ *
+ * usage: rosrun CCO_VOXEL qmcVariance [weight.csv]
+ *
+ * Waypoint distributions follow the optimizer, max(0, safeRadius - (dist + N(0, 1))).
+ * For every sampling mode and sample count n it reports
+ *   - the variance of the normalized MMD estimate (MMD / n^2, polynomial and RBF kernel on the
+ *     raw samples), averaged over dist in [0, 2] m
+ *   - the Kendall tau between the cost ranking of 50 rollouts and a 4096 sample reference
+ * and the smallest n whose variance is at most the one of 100 pseudo random samples.
+ * A lower variance is only worth something when the mean is unchanged, so for every dist it
+ * also reports the mean of every sampling at n = 100 against the pseudo random (Philox) one,
+ * the relative difference and its 95% confidence interval over NUM_MEAN_REPLICATES draws.
+ * With a weight file the transformed-feature MMD, which is tied to n = 100 by the weight
+ * matrix and depends on the order of the samples, gets the variance and the mean tables too.
+ **/
+#include "CCO_VOXEL/MMD_kernels.h"
+#include "CCO_VOXEL/MMD_moments.h"
+#include "CCO_VOXEL/qmc_noise.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+static const float safeRadius = 1.0;
+static const int NUM_REPLICATES = 400;
+static const int NUM_MEAN_REPLICATES = 4000;
+
+static void sample_distribution(RandomStreams::NoiseSampling sampling, uint32_t replicate, uint32_t point, float dist, int n, std::vector<float> &samples)
+{
+    samples.resize(n);
+
+    RandomStreams::fill_noise(sampling, RandomStreams::Stream(RandomStreams::CEM_COLLISION, 0, replicate, n, point), samples.data(), n, dist, 1.0);
+
+    for (int i = 0; i < n; i++)
+    {
+        samples[i] = std::max(0.0f, safeRadius - samples[i]);
+    }
+}
+
+/** MMD^2 of the polynomial kernel against the all zero distribution, 2 mean^2 + mean_sq^2 **/
+static double normalized_polynomial_MMD(const std::vector<float> &samples)
+{
+    MMDFunctions::PolynomialMoments moments = MMDFunctions::polynomial_moments(Eigen::Map<const Eigen::VectorXf>(samples.data(), samples.size()));
+    double mean = moments.sum / moments.count;
+    double mean_sq = moments.sum_sq / moments.count;
+
+    return 2 * mean * mean + mean_sq * mean_sq;
+}
+
+static double normalized_rbf_MMD(const std::vector<float> &samples)
+{
+    double n = double(samples.size());
+
+    return MMDFunctions::rbf_MMD(samples.data(), int(samples.size())) / (n * n);
+}
+
+static double variance(const std::vector<double> &values)
+{
+    double mean = 0, var = 0;
+
+    for (double v : values)
+        mean += v / values.size();
+    for (double v : values)
+        var += (v - mean) * (v - mean) / (values.size() - 1);
+
+    return var;
+}
+
+static double kendall_tau(const std::vector<double> &a, const std::vector<double> &b)
+{
+    int concordant = 0, discordant = 0;
+
+    for (int i = 0; i < int(a.size()); i++)
+    {
+        for (int j = i + 1; j < int(a.size()); j++)
+        {
+            double s = (a[i] - a[j]) * (b[i] - b[j]);
+            if (s > 0)
+                concordant++;
+            else if (s < 0)
+                discordant++;
+        }
+    }
+
+    return double(concordant - discordant) / double(a.size() * (a.size() - 1) / 2);
+}
+
+static void mean_and_variance(const std::vector<double> &values, double &mean, double &var)
+{
+    mean = 0;
+    for (double v : values)
+        mean += v / values.size();
+
+    var = variance(values);
+}
+
+/** mean of every sampling against the pseudo random one, per dist, n = 100 **/
+static void print_mean_table(const char *title, const std::function<double(const std::vector<float> &)> &estimate)
+{
+    const char *mode_names[3] = {"random", "stratified", "sobol"};
+    const int num_dists = 9;
+    std::vector<float> samples;
+
+    printf("%s, mean over %d draws of n = %d, relative to random (95%% interval)\n%6s %14s", title, NUM_MEAN_REPLICATES, MMDFunctions::NUM_DISTRIBUTION_SAMPLES, "dist", "random");
+    for (int mode = 1; mode < 3; mode++)
+        printf(" %14s %22s", mode_names[mode], "difference");
+    printf("\n");
+
+    for (int k = 0; k < num_dists; k++)
+    {
+        float dist = 2.0f * k / (num_dists - 1);
+        double mean[3], var[3];
+
+        for (int mode = 0; mode < 3; mode++)
+        {
+            std::vector<double> values(NUM_MEAN_REPLICATES);
+
+            for (int r = 0; r < NUM_MEAN_REPLICATES; r++)
+            {
+                // replicates independent of the variance runs
+                sample_distribution(RandomStreams::NoiseSampling(mode), 100000 + r, k, dist, MMDFunctions::NUM_DISTRIBUTION_SAMPLES, samples);
+                values[r] = estimate(samples);
+            }
+
+            mean_and_variance(values, mean[mode], var[mode]);
+        }
+
+        printf("%6.2f %14.5g", dist, mean[0]);
+
+        for (int mode = 1; mode < 3; mode++)
+        {
+            double difference = mean[mode] - mean[0];
+            double half_width = 1.96 * std::sqrt((var[mode] + var[0]) / NUM_MEAN_REPLICATES);
+            double scale = mean[0] != 0 ? 100.0 / mean[0] : 0.0;
+
+            printf(" %14.5g %+9.2f%% +- %6.2f%%", mean[mode], difference * scale, half_width * scale);
+        }
+        printf("\n");
+    }
+    printf("\n");
+}
+
+struct ModeResult
+{
+    double poly_variance;
+    double rbf_variance;
+    double tau;
+};
+
+int main(int argc, char **argv)
+{
+
+    const char *mode_names[3] = {"random", "stratified", "sobol"};
+    const int counts[] = {8, 12, 16, 20, 24, 32, 48, 64, 100};
+    const int num_counts = sizeof(counts) / sizeof(counts[0]);
+
+    // rollouts for the ranking test, 50 trajectories x 50 waypoint distances
+    const int num_trajs = 50, pts_per_traj = 50;
+    std::vector<float> rollout_dist(num_trajs * pts_per_traj);
+    RandomStreams::Stream(RandomStreams::CEM_TABLE, 0).fill_uniform(rollout_dist.data(), int(rollout_dist.size()));
+    for (float &d : rollout_dist)
+        d *= 2.5f;
+
+    std::vector<float> samples;
+    std::vector<double> reference_cost(num_trajs, 0);
+
+    for (int t = 0; t < num_trajs; t++)
+    {
+        for (int p = 0; p < pts_per_traj; p++)
+        {
+            sample_distribution(RandomStreams::STRATIFIED, 0, t * pts_per_traj + p, rollout_dist[t * pts_per_traj + p], 4096, samples);
+            reference_cost[t] += normalized_polynomial_MMD(samples);
+        }
+    }
+
+    ModeResult results[3][num_counts];
+
+    for (int mode = 0; mode < 3; mode++)
+    {
+        RandomStreams::NoiseSampling sampling = RandomStreams::NoiseSampling(mode);
+
+        for (int c = 0; c < num_counts; c++)
+        {
+            int n = counts[c];
+            double poly_var = 0, rbf_var = 0;
+            int num_dists = 9;
+
+            for (int k = 0; k < num_dists; k++)
+            {
+                float dist = 2.0f * k / (num_dists - 1);
+                std::vector<double> poly(NUM_REPLICATES), rbf(NUM_REPLICATES);
+
+                for (int r = 0; r < NUM_REPLICATES; r++)
+                {
+                    sample_distribution(sampling, r, k, dist, n, samples);
+                    poly[r] = normalized_polynomial_MMD(samples);
+                    rbf[r] = normalized_rbf_MMD(samples);
+                }
+
+                poly_var += variance(poly) / num_dists;
+                rbf_var += variance(rbf) / num_dists;
+            }
+
+            double tau = 0;
+            int num_rankings = 20;
+
+            for (int r = 0; r < num_rankings; r++)
+            {
+                std::vector<double> cost(num_trajs, 0);
+
+                for (int t = 0; t < num_trajs; t++)
+                {
+                    for (int p = 0; p < pts_per_traj; p++)
+                    {
+                        sample_distribution(sampling, 1000 + r, t * pts_per_traj + p, rollout_dist[t * pts_per_traj + p], n, samples);
+                        cost[t] += normalized_polynomial_MMD(samples);
+                    }
+                }
+
+                tau += kendall_tau(cost, reference_cost) / num_rankings;
+            }
+
+            results[mode][c] = {poly_var, rbf_var, tau};
+        }
+    }
+
+    const ModeResult &baseline = results[RandomStreams::PSEUDO_RANDOM][num_counts - 1];
+
+    for (int mode = 0; mode < 3; mode++)
+    {
+        printf("%s\n%6s %16s %16s %12s\n", mode_names[mode], "n", "var poly MMD", "var RBF MMD", "kendall tau");
+
+        int match_poly = -1, match_rbf = -1;
+
+        for (int c = 0; c < num_counts; c++)
+        {
+            printf("%6d %16.4e %16.4e %12.4f\n", counts[c], results[mode][c].poly_variance, results[mode][c].rbf_variance, results[mode][c].tau);
+
+            if (match_poly < 0 && results[mode][c].poly_variance <= baseline.poly_variance)
+                match_poly = counts[c];
+            if (match_rbf < 0 && results[mode][c].rbf_variance <= baseline.rbf_variance)
+                match_rbf = counts[c];
+        }
+
+        printf("samples matching 100 random: polynomial %d, RBF %d (-1: none)\n\n", match_poly, match_rbf);
+    }
+
+    print_mean_table("polynomial MMD", normalized_polynomial_MMD);
+    print_mean_table("RBF MMD", normalized_rbf_MMD);
+
+    if (argc > 1)
+    {
+        MMDFunctions::WeightMatrix weights;
+
+        if (!MMDFunctions::load_weights(argv[1], weights))
+            return 1;
+
+        printf("transformed features, n = %d\n%12s %16s\n", MMDFunctions::NUM_DISTRIBUTION_SAMPLES, "sampling", "var MMD");
+
+        for (int mode = 0; mode < 3; mode++)
+        {
+            double var = 0;
+            int num_dists = 9;
+
+            for (int k = 0; k < num_dists; k++)
+            {
+                float dist = 2.0f * k / (num_dists - 1);
+                std::vector<double> values(NUM_REPLICATES);
+
+                for (int r = 0; r < NUM_REPLICATES; r++)
+                {
+                    sample_distribution(RandomStreams::NoiseSampling(mode), r, k, dist, MMDFunctions::NUM_DISTRIBUTION_SAMPLES, samples);
+                    values[r] = MMDFunctions::transformed_MMD(Eigen::Map<const Eigen::RowVectorXf>(samples.data(), samples.size()), weights);
+                }
+
+                var += variance(values) / num_dists;
+            }
+
+            printf("%12s %16.4e\n", mode_names[mode], var);
+        }
+
+        printf("\n");
+        print_mean_table("transformed features", [&](const std::vector<float> &x)
+                         { return double(MMDFunctions::transformed_MMD(Eigen::Map<const Eigen::RowVectorXf>(x.data(), x.size()), weights)); });
+    }
+
+    return 0;
+}
@@ -0,0 +1,113 @@
+/**
+ * Accuracy vs dimension report for the random Fourier feature MMD
+ *
+ * usage: rosrun CCO_VOXEL rffAccuracy [weight_rbf.csv]
+ *
+ * Draws distance distributions max(0, safeRadius - (dist + N(0, 1))) with dist in [0, 2] m,
+ * as sampled by the optimizer, and compares RFF_KERNEL against the exact RBF MMD for a range
+ * of feature dimensions D: on the 100 raw samples, and on the transformed features when a
+ * weight file is given. Errors are relative to the exact MMD.
+ **/
+#include "CCO_VOXEL/MMD_kernels.h"
+#include "CCO_VOXEL/MMD_rff.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(const char *title, const std::vector<Eigen::VectorXf> &samples)
+{
+    int num_cases = int(samples.size());
+    std::vector<float> exact(num_cases);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int c = 0; c < num_cases; c++)
+    {
+        exact[c] = MMDFunctions::rbf_MMD(samples[c].data(), int(samples[c].size()));
+    }
+    double exact_ns = 1e9 * seconds_since(start) / num_cases;
+
+    printf("%s, N = %d, exact RBF (%s): %.0f ns/eval\n", title, int(samples[0].size()), MMDFunctions::rbf_simd_level(), exact_ns);
+    printf("%8s %14s %14s %12s\n", "D", "mean rel err", "max rel err", "ns/eval");
+
+    for (int dimension : {16, 32, 64, 128, 256, 512, 1024})
+    {
+        MMDFunctions::RandomFourierFeatures features(dimension);
+
+        double mean_error = 0;
+        double max_error = 0;
+        std::vector<float> approx(num_cases);
+
+        start = std::chrono::steady_clock::now();
+        for (int c = 0; c < num_cases; c++)
+        {
+            approx[c] = features.MMD(samples[c].data(), int(samples[c].size()));
+        }
+        double approx_ns = 1e9 * seconds_since(start) / num_cases;
+
+        for (int c = 0; c < num_cases; c++)
+        {
+            double error = std::abs(approx[c] - exact[c]) / std::max(std::abs(exact[c]), 1.0f);
+            mean_error += error / num_cases;
+            max_error = std::max(max_error, error);
+        }
+
+        printf("%8d %14.3e %14.3e %12.0f\n", dimension, mean_error, max_error, approx_ns);
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+
+    int num_cases = 2000;
+    float safeRadius = 1.0;
+
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<float> distance(0.0, 2.0);
+    std::normal_distribution<float> noise(0.0, 1.0);
+
+    std::vector<Eigen::VectorXf> raw_samples(num_cases);
+
+    for (int c = 0; c < num_cases; c++)
+    {
+        float dist = distance(gen);
+
+        raw_samples[c].resize(MMDFunctions::NUM_DISTRIBUTION_SAMPLES);
+        for (int i = 0; i < MMDFunctions::NUM_DISTRIBUTION_SAMPLES; i++)
+        {
+            raw_samples[c](i) = std::max(0.0f, safeRadius - (dist + noise(gen)));
+        }
+    }
+
+    report("raw samples", raw_samples);
+
+    if (argc > 1)
+    {
+        MMDFunctions::WeightMatrix weights;
+
+        if (!MMDFunctions::load_weights(argv[1], weights))
+        {
+            return 1;
+        }
+
+        std::vector<Eigen::VectorXf> transformed_samples(num_cases);
+
+        for (int c = 0; c < num_cases; c++)
+        {
+            transformed_samples[c] = (raw_samples[c].transpose() * weights).transpose();
+        }
+
+        report("transformed features", transformed_samples);
+    }
+
+    return 0;
+}